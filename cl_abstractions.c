@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <CL/opencl.h>
 
 #include "main.h"
@@ -6,91 +8,215 @@
 #include "cl_error.h"
 
 /*
- * Creates a context using available devices and creates the command queue.
- * Some information about the platform and available devices is printed to
- * stdout.
+ * Returns a newly allocated string containing the requested platform info.
  */
-void cl_initialise(cl_vars *cl)
+char *cl_platform_string(cl_platform_id platform, cl_platform_info param)
 {
     cl_int  err_ret;
     size_t  n_bytes;
-    char    *platform_name;
-    char    *platform_version;
-    char    *device_name;
-
-    // Retrieve the platform
-    err_ret = clGetPlatformIDs(1, &cl->platform, NULL);
-    check_error(__FILE__, __LINE__, err_ret);
+    char    *str;
 
-    // Retrieve the platform name
-    err_ret = clGetPlatformInfo(cl->platform, CL_PLATFORM_NAME, 0, NULL,
-        &n_bytes);
+    err_ret = clGetPlatformInfo(platform, param, 0, NULL, &n_bytes);
     check_error(__FILE__, __LINE__, err_ret);
-    platform_name = malloc(n_bytes);
-    err_ret = clGetPlatformInfo(cl->platform, CL_PLATFORM_NAME, n_bytes,
-        platform_name, NULL);
+    str = malloc(n_bytes);
+    err_ret = clGetPlatformInfo(platform, param, n_bytes, str, NULL);
     check_error(__FILE__, __LINE__, err_ret);
-    fprintf(stderr, "CL_PLATFORM_NAME = %s\n", platform_name);
 
-    // Retrieve the platform version
-    err_ret = clGetPlatformInfo(cl->platform, CL_PLATFORM_VERSION, 0, NULL,
-        &n_bytes);
+    return str;
+}
+
+/*
+ * Returns a newly allocated string containing the requested device info.
+ */
+char *cl_device_string(cl_device_id device, cl_device_info param)
+{
+    cl_int  err_ret;
+    size_t  n_bytes;
+    char    *str;
+
+    err_ret = clGetDeviceInfo(device, param, 0, NULL, &n_bytes);
     check_error(__FILE__, __LINE__, err_ret);
-    platform_version = malloc(n_bytes);
-    err_ret = clGetPlatformInfo(cl->platform, CL_PLATFORM_VERSION, n_bytes,
-        platform_version, NULL);
+    str = malloc(n_bytes);
+    err_ret = clGetDeviceInfo(device, param, n_bytes, str, NULL);
     check_error(__FILE__, __LINE__, err_ret);
-    fprintf(stderr, "CL_PLATFORM_VERSION = %s\n", platform_version);
 
-    // Retrieve a list of devices
-    err_ret = clGetDeviceIDs(cl->platform, CL_DEVICE_TYPE_GPU, 0, NULL,
-        &cl->n_devices);
+    return str;
+}
+
+/*
+ * Finds the devices of the requested type on every platform, optionally
+ * filtered by a substring of the device name. The matching devices are
+ * numbered in the order they are found and printed to stderr.
+ */
+void cl_find_devices(ga_settings *settings, cl_device_list *list)
+{
+    cl_int          err_ret;
+    cl_uint         n_platforms;
+    cl_platform_id  *platforms;
+    cl_device_type  device_type;
+
+    // Map the requested device type
+    switch (settings->device_type)
+    {
+        case DEVICE_CPU:
+            device_type = CL_DEVICE_TYPE_CPU;
+            break;
+        case DEVICE_ACCELERATOR:
+            device_type = CL_DEVICE_TYPE_ACCELERATOR;
+            break;
+        case DEVICE_ALL:
+            device_type = CL_DEVICE_TYPE_ALL;
+            break;
+        case DEVICE_GPU:
+        default:
+            device_type = CL_DEVICE_TYPE_GPU;
+            break;
+    }
+
+    // Retrieve the platforms
+    err_ret = clGetPlatformIDs(0, NULL, &n_platforms);
     check_error(__FILE__, __LINE__, err_ret);
-    cl->devices = malloc(cl->n_devices*sizeof(cl_device_id));
-    err_ret = clGetDeviceIDs(cl->platform, CL_DEVICE_TYPE_GPU, cl->n_devices,
-        cl->devices, NULL);
+    platforms = malloc(n_platforms*sizeof(cl_platform_id));
+    err_ret = clGetPlatformIDs(n_platforms, platforms, NULL);
     check_error(__FILE__, __LINE__, err_ret);
 
-    // Retrieve device info
-    for (int i = 0; i < cl->n_devices; i++)
+    list->n_devices = 0;
+    list->platforms = NULL;
+    list->devices = NULL;
+
+    for (int p = 0; p < n_platforms; p++)
     {
-        err_ret = clGetDeviceInfo(cl->devices[i], CL_DEVICE_NAME, 0, NULL,
-            &n_bytes);
+        cl_uint         n_devices;
+        cl_device_id    *devices;
+
+        char *platform_name = cl_platform_string(platforms[p],
+            CL_PLATFORM_NAME);
+        char *platform_version = cl_platform_string(platforms[p],
+            CL_PLATFORM_VERSION);
+        fprintf(stderr, "CL_PLATFORM_NAME = %s\n", platform_name);
+        fprintf(stderr, "CL_PLATFORM_VERSION = %s\n", platform_version);
+        free(platform_name);
+        free(platform_version);
+
+        // Retrieve the devices of the requested type, if there are any
+        err_ret = clGetDeviceIDs(platforms[p], device_type, 0, NULL,
+            &n_devices);
+        if (err_ret == CL_DEVICE_NOT_FOUND)
+        {
+            continue;
+        }
         check_error(__FILE__, __LINE__, err_ret);
-        device_name = malloc(n_bytes);
-        err_ret = clGetDeviceInfo(cl->devices[i], CL_DEVICE_NAME, n_bytes,
-            device_name, NULL);
+        devices = malloc(n_devices*sizeof(cl_device_id));
+        err_ret = clGetDeviceIDs(platforms[p], device_type, n_devices,
+            devices, NULL);
         check_error(__FILE__, __LINE__, err_ret);
-        fprintf(stderr, "[Device %d] CL_DEVICE_NAME = %s\n", i, device_name);
+
+        list->platforms = realloc(list->platforms,
+            (list->n_devices + n_devices)*sizeof(cl_platform_id));
+        list->devices = realloc(list->devices,
+            (list->n_devices + n_devices)*sizeof(cl_device_id));
+
+        for (int i = 0; i < n_devices; i++)
+        {
+            char *device_name = cl_device_string(devices[i], CL_DEVICE_NAME);
+
+            // Skip devices which do not match the name filter
+            if (settings->device_name != NULL &&
+                strstr(device_name, settings->device_name) == NULL)
+            {
+                free(device_name);
+                continue;
+            }
+
+            fprintf(stderr, "[Device %d] CL_DEVICE_NAME = %s\n",
+                list->n_devices, device_name);
+            list->platforms[list->n_devices] = platforms[p];
+            list->devices[list->n_devices] = devices[i];
+            list->n_devices++;
+            free(device_name);
+        }
+
+        free(devices);
+    }
+
+    free(platforms);
+
+    if (list->n_devices == 0)
+    {
+        fprintf(stderr, "No matching OpenCL devices found (see "
+            "--device-type and --device-name)\n");
+        exit(EXIT_FAILURE);
     }
+}
 
-    // If the device was unspecified exit after listing available devices
-    if (cl->device_id == -1)
+/*
+ * Partitions a CPU device into one sub-device per NUMA node, returning the
+ * number of sub-devices, or 0 if the device is not a CPU or cannot be
+ * partitioned this way.
+ */
+int cl_split_numa(cl_device_id device, cl_device_id **sub_devices)
+{
+    cl_int          err_ret;
+    cl_device_type  type;
+    cl_uint         n_sub;
+
+    err_ret = clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(type), &type,
+        NULL);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    if (!(type & CL_DEVICE_TYPE_CPU))
     {
-        exit(EXIT_SUCCESS);
+        return 0;
     }
 
-    // Retrieve the max work group size
-    err_ret = clGetDeviceInfo(cl->devices[cl->device_id],
-        CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(cl->max_work_size),
-        &cl->max_work_size, NULL);
+    cl_device_partition_property properties[] =
+    {
+        CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN,
+        CL_DEVICE_AFFINITY_DOMAIN_NUMA, 0
+    };
+
+    err_ret = clCreateSubDevices(device, properties, 0, NULL, &n_sub);
+    if (err_ret != CL_SUCCESS)
+    {
+        return 0;
+    }
+
+    *sub_devices = malloc(n_sub*sizeof(cl_device_id));
+    err_ret = clCreateSubDevices(device, properties, n_sub, *sub_devices,
+        NULL);
     check_error(__FILE__, __LINE__, err_ret);
-    fprintf(stderr, "CL_DEVICE_MAX_WORK_GROUP_SIZE = %d\n", cl->max_work_size);
 
-    // Create a context 
-    cl->context = clCreateContext(NULL, 1, &cl->devices[cl->device_id], NULL,
-        NULL, &err_ret);
+    return n_sub;
+}
+
+/*
+ * Creates a context and command queue for the device selected in cl.
+ */
+void cl_initialise(cl_vars *cl)
+{
+    cl_int  err_ret;
+
+    // Retrieve the max work group size
+    err_ret = clGetDeviceInfo(cl->device, CL_DEVICE_MAX_WORK_GROUP_SIZE,
+        sizeof(cl->max_work_size), &cl->max_work_size, NULL);
     check_error(__FILE__, __LINE__, err_ret);
+    fprintf(stderr, "[Device %d] CL_DEVICE_MAX_WORK_GROUP_SIZE = %d\n",
+        cl->device_id, (int)cl->max_work_size);
 
-    // Create a command queue for the desired device
-    cl->queue = clCreateCommandQueue(cl->context,
-        cl->devices[cl->device_id], 0, &err_ret);
+    // Create a context on the device's platform
+    cl_context_properties properties[] =
+    {
+        CL_CONTEXT_PLATFORM, (cl_context_properties)cl->platform, 0
+    };
+    cl->context = clCreateContext(properties, 1, &cl->device, NULL, NULL,
+        &err_ret);
     check_error(__FILE__, __LINE__, err_ret);
 
-    // Free allocated memory
-    free(platform_name);
-    free(platform_version);
-    free(device_name);
+    // Create a command queue for the desired device, with profiling if the
+    // device timeline is being traced
+    cl->queue = clCreateCommandQueue(cl->context, cl->device,
+        cl->profiling ? CL_QUEUE_PROFILING_ENABLE : 0, &err_ret);
+    check_error(__FILE__, __LINE__, err_ret);
 }
 
 /*
@@ -136,7 +262,7 @@ void cl_create_program(cl_vars *cl, cl_program *program, char *filename)
     check_error(__FILE__, __LINE__, err_ret);
 
     // Check the build status for errors
-    err_ret = clGetProgramBuildInfo(*program, cl->devices[cl->device_id],
+    err_ret = clGetProgramBuildInfo(*program, cl->device,
         CL_PROGRAM_BUILD_STATUS, sizeof(cl_build_status), &build_status, 0);
     check_error(__FILE__, __LINE__, err_ret);
     
@@ -144,11 +270,11 @@ void cl_create_program(cl_vars *cl, cl_program *program, char *filename)
     if (build_status != CL_BUILD_SUCCESS)
     {
         // Get the build log
-        err_ret = clGetProgramBuildInfo(*program, cl->devices[cl->device_id],
+        err_ret = clGetProgramBuildInfo(*program, cl->device,
             CL_PROGRAM_BUILD_LOG, 0, NULL, &n_bytes);
         check_error(__FILE__, __LINE__, err_ret);
         build_log = malloc(n_bytes);
-        err_ret = clGetProgramBuildInfo(*program, cl->devices[cl->device_id],
+        err_ret = clGetProgramBuildInfo(*program, cl->device,
             CL_PROGRAM_BUILD_LOG, n_bytes, build_log, NULL);
         check_error(__FILE__, __LINE__, err_ret);
 
@@ -1,14 +1,25 @@
 typedef struct
 {
     cl_platform_id      platform;
-    cl_uint             n_devices;
-    cl_device_id        *devices;
+    cl_device_id        device;
     int                 device_id;
+    int                 profiling;
     size_t              max_work_size;
     cl_context          context;
     cl_command_queue    queue;
 } cl_vars;
 
+typedef struct
+{
+    int                 n_devices;
+    cl_platform_id      *platforms;
+    cl_device_id        *devices;
+} cl_device_list;
+
+char *cl_platform_string(cl_platform_id platform, cl_platform_info param);
+char *cl_device_string(cl_device_id device, cl_device_info param);
+void cl_find_devices(ga_settings *settings, cl_device_list *list);
+int cl_split_numa(cl_device_id device, cl_device_id **sub_devices);
 void cl_initialise(cl_vars *cl);
 void cl_create_program(cl_vars *cl, cl_program *program, char *filename);
 void cl_create_kernel(cl_vars *cl, cl_program *program, cl_kernel *kernel, char
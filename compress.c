@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "main.h"
+#include "compress.h"
+
+// Shortest match worth encoding, the furthest back a match may start, and the
+// size of the table used to find matches
+#define COMPRESS_MIN_MATCH  4
+#define COMPRESS_MAX_OFFSET 65535
+#define COMPRESS_HASH_BITS  14
+
+// The first byte of each block gives how it was stored
+#define COMPRESS_STORED     0
+#define COMPRESS_SHUFFLED   1
+
+/*
+ * Returns the largest size a block of n bytes can compress to.
+ */
+size_t compress_bound(size_t n)
+{
+    return 1 + n + n/255 + 16;
+}
+
+/*
+ * Groups the bytes of n bytes of width-byte values by their significance, so
+ * that the slowly changing sign and exponent bytes of neighbouring floats
+ * end up next to each other. Any bytes left over are copied as they are.
+ */
+void compress_shuffle(const unsigned char *in, unsigned char *out, size_t n,
+    int width)
+{
+    size_t count = n/width;
+
+    for (int b = 0; b < width; b++)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            out[b*count + i] = in[i*width + b];
+        }
+    }
+
+    memcpy(out + count*width, in + count*width, n - count*width);
+}
+
+/*
+ * Reverses compress_shuffle.
+ */
+void compress_unshuffle(const unsigned char *in, unsigned char *out, size_t n,
+    int width)
+{
+    size_t count = n/width;
+
+    for (int b = 0; b < width; b++)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i*width + b] = in[b*count + i];
+        }
+    }
+
+    memcpy(out + count*width, in + count*width, n - count*width);
+}
+
+/*
+ * Writes the part of a length which does not fit in its token, as a run of
+ * 255s followed by the remainder.
+ */
+unsigned char *compress_length(unsigned char *op, size_t length)
+{
+    while (length >= 255)
+    {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (unsigned char)length;
+
+    return op;
+}
+
+/*
+ * Writes one sequence: a token holding the number of literals and the match
+ * length, the literals, then the offset of the match. The final sequence of a
+ * block has no match.
+ */
+unsigned char *compress_sequence(unsigned char *op, const unsigned char *lit,
+    size_t n_lit, size_t offset, size_t match)
+{
+    unsigned char *token = op++;
+    size_t m = match > 0 ? match - COMPRESS_MIN_MATCH : 0;
+
+    *token = (unsigned char)((MIN(n_lit, 15) << 4) | MIN(m, 15));
+
+    if (n_lit >= 15)
+    {
+        op = compress_length(op, n_lit - 15);
+    }
+    memcpy(op, lit, n_lit);
+    op += n_lit;
+
+    if (match > 0)
+    {
+        *op++ = offset & 0xff;
+        *op++ = offset >> 8;
+
+        if (m >= 15)
+        {
+            op = compress_length(op, m - 15);
+        }
+    }
+
+    return op;
+}
+
+/*
+ * Compresses n bytes with a byte-oriented LZ77 coder in the style of LZ4.
+ * Matches are found through a table of the last position each four-byte
+ * sequence was seen, which is fast rather than thorough. Returns the
+ * compressed size, which is at most compress_bound(n) - 1.
+ */
+size_t compress_lz(const unsigned char *in, size_t n, unsigned char *out)
+{
+    uint32_t        *table = malloc(sizeof(uint32_t) << COMPRESS_HASH_BITS);
+    unsigned char   *op = out;
+    size_t          anchor = 0;
+    size_t          i = 0;
+
+    // Positions are stored plus one, so zero means unseen
+    memset(table, 0, sizeof(uint32_t) << COMPRESS_HASH_BITS);
+
+    while (i + COMPRESS_MIN_MATCH <= n)
+    {
+        uint32_t v;
+        memcpy(&v, in + i, sizeof(v));
+        uint32_t h = (v*2654435761u) >> (32 - COMPRESS_HASH_BITS);
+        size_t cand = table[h];
+        table[h] = (uint32_t)(i + 1);
+
+        if (cand == 0 || i - (cand - 1) > COMPRESS_MAX_OFFSET ||
+            memcmp(in + cand - 1, in + i, COMPRESS_MIN_MATCH) != 0)
+        {
+            i++;
+            continue;
+        }
+
+        // Extend the match as far as it goes
+        cand--;
+        size_t match = COMPRESS_MIN_MATCH;
+        while (i + match < n && in[cand + match] == in[i + match])
+        {
+            match++;
+        }
+
+        op = compress_sequence(op, in + anchor, i - anchor, i - cand, match);
+        i += match;
+        anchor = i;
+    }
+
+    op = compress_sequence(op, in + anchor, n - anchor, 0, 0);
+    free(table);
+
+    return op - out;
+}
+
+/*
+ * Decompresses a block written by compress_lz into raw bytes. Returns -1 if
+ * the block is corrupt or does not decompress to exactly raw bytes.
+ */
+int decompress_lz(const unsigned char *in, size_t n, unsigned char *out,
+    size_t raw)
+{
+    const unsigned char *ip = in;
+    const unsigned char *end = in + n;
+    unsigned char       *op = out;
+
+    while (ip < end)
+    {
+        unsigned char token = *ip++;
+        size_t n_lit = token >> 4;
+        size_t match = token & 15;
+
+        if (n_lit == 15)
+        {
+            unsigned char b;
+            do
+            {
+                if (ip >= end)
+                {
+                    return -1;
+                }
+                b = *ip++;
+                n_lit += b;
+            } while (b == 255);
+        }
+
+        if (n_lit > (size_t)(end - ip) || n_lit > raw - (op - out))
+        {
+            return -1;
+        }
+        memcpy(op, ip, n_lit);
+        ip += n_lit;
+        op += n_lit;
+
+        // The final sequence has no match
+        if (ip == end)
+        {
+            break;
+        }
+
+        if (end - ip < 2)
+        {
+            return -1;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        if (match == 15)
+        {
+            unsigned char b;
+            do
+            {
+                if (ip >= end)
+                {
+                    return -1;
+                }
+                b = *ip++;
+                match += b;
+            } while (b == 255);
+        }
+        match += COMPRESS_MIN_MATCH;
+
+        if (offset == 0 || offset > (size_t)(op - out) ||
+            match > raw - (op - out))
+        {
+            return -1;
+        }
+
+        // Copy a byte at a time, as the match may overlap its own output
+        for (size_t j = 0; j < match; j++, op++)
+        {
+            *op = *(op - offset);
+        }
+    }
+
+    return (size_t)(op - out) == raw ? 0 : -1;
+}
+
+/*
+ * Compresses a block of n bytes of width-byte values into out, which must
+ * hold compress_bound(n) bytes. The values are shuffled and then LZ coded,
+ * unless that would not make the block smaller, in which case it is stored.
+ * Returns the size of the compressed block.
+ */
+size_t compress_block(const void *in, size_t n, void *out, int width)
+{
+    unsigned char   *shuffled = malloc(n);
+    unsigned char   *op = out;
+    size_t          size;
+
+    compress_shuffle(in, shuffled, n, width);
+    size = compress_lz(shuffled, n, op + 1);
+    free(shuffled);
+
+    if (size < n)
+    {
+        op[0] = COMPRESS_SHUFFLED;
+        return size + 1;
+    }
+
+    op[0] = COMPRESS_STORED;
+    memcpy(op + 1, in, n);
+
+    return n + 1;
+}
+
+/*
+ * Decompresses a block written by compress_block into raw bytes. Returns -1
+ * if the block is corrupt.
+ */
+int decompress_block(const void *in, size_t n, void *out, size_t raw,
+    int width)
+{
+    const unsigned char *ip = in;
+
+    if (n < 1)
+    {
+        return -1;
+    }
+
+    if (ip[0] == COMPRESS_STORED)
+    {
+        if (n - 1 != raw)
+        {
+            return -1;
+        }
+        memcpy(out, ip + 1, raw);
+        return 0;
+    }
+
+    if (ip[0] != COMPRESS_SHUFFLED)
+    {
+        return -1;
+    }
+
+    unsigned char *shuffled = malloc(raw);
+    int ret = decompress_lz(ip + 1, n - 1, shuffled, raw);
+
+    if (ret == 0)
+    {
+        compress_unshuffle(shuffled, out, raw, width);
+    }
+    free(shuffled);
+
+    return ret;
+}
@@ -0,0 +1,4 @@
+size_t compress_bound(size_t n);
+size_t compress_block(const void *in, size_t n, void *out, int width);
+int decompress_block(const void *in, size_t n, void *out, size_t raw,
+    int width);
@@ -0,0 +1,190 @@
+#define _FILE_OFFSET_BITS 64
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "compress.h"
+#include "container.h"
+
+/*
+ * A container holds blocks of float rows, one block per loop, each compressed
+ * on its own so that any one can be decoded without the others. The file is
+ * the magic number, version and header, then the blocks in the order they
+ * were written, then an index of the blocks in loop order, then the offset of
+ * the index and the number of blocks. The index is read from the end of the
+ * file, so blocks can be written as soon as each is compressed.
+ */
+
+/*
+ * Creates a container and writes its header. Blocks are then appended to the
+ * returned file.
+ */
+FILE *container_create(char *filename, container_header *header)
+{
+    FILE    *fp;
+    int     version = CONTAINER_VERSION;
+
+    // Open the file
+    fp = fopen(filename, "wb");
+
+    // Check the return value
+    if (fp == NULL)
+    {
+        fprintf(stderr, "%s: ", filename);
+        perror("");
+        exit(EXIT_FAILURE);
+    }
+
+    // Write the magic number, version and header
+    fwrite(CONTAINER_MAGIC, 1, strlen(CONTAINER_MAGIC), fp);
+    fwrite(&version, sizeof(version), 1, fp);
+    fwrite(header, sizeof(container_header), 1, fp);
+
+    return fp;
+}
+
+int container_compare(const void *a, const void *b)
+{
+    long long la = ((const container_entry *)a)->loop;
+    long long lb = ((const container_entry *)b)->loop;
+
+    return (la > lb) - (la < lb);
+}
+
+/*
+ * Sorts the index into loop order, writes it after the blocks along with the
+ * header's final block count, and closes the container.
+ */
+void container_finish(char *filename, FILE *fp, container_header *header,
+    container_entry *index)
+{
+    long long index_offset;
+
+    qsort(index, header->n_blocks, sizeof(container_entry), container_compare);
+
+    fseeko(fp, 0, SEEK_END);
+    index_offset = ftello(fp);
+    fwrite(index, sizeof(container_entry), header->n_blocks, fp);
+    fwrite(&index_offset, sizeof(index_offset), 1, fp);
+    fwrite(&header->n_blocks, sizeof(header->n_blocks), 1, fp);
+
+    // Rewrite the header with the block count
+    fseeko(fp, strlen(CONTAINER_MAGIC) + sizeof(int), SEEK_SET);
+    fwrite(header, sizeof(container_header), 1, fp);
+
+    if (ferror(fp) || fclose(fp) != 0)
+    {
+        fprintf(stderr, "%s: Unable to write container\n", filename);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Opens a container written by container_finish, filling in the header and
+ * returning its index in newly allocated memory.
+ */
+FILE *container_open(char *filename, container_header *header,
+    container_entry **index)
+{
+    FILE        *fp;
+    char        magic[sizeof(CONTAINER_MAGIC)] = {0};
+    int         version;
+    long long   index_offset;
+    long long   n_blocks;
+
+    // Open the file
+    fp = fopen(filename, "rb");
+
+    // Check the return value
+    if (fp == NULL)
+    {
+        fprintf(stderr, "%s: ", filename);
+        perror("");
+        exit(EXIT_FAILURE);
+    }
+
+    // Check the magic number and version
+    if (fread(magic, 1, strlen(CONTAINER_MAGIC), fp) !=
+        strlen(CONTAINER_MAGIC) || strcmp(magic, CONTAINER_MAGIC) != 0)
+    {
+        fprintf(stderr, "%s: Not a compressed container\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    if (fread(&version, sizeof(version), 1, fp) != 1 ||
+        version != CONTAINER_VERSION)
+    {
+        fprintf(stderr, "%s: Unsupported container version\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    if (fread(header, sizeof(container_header), 1, fp) != 1)
+    {
+        fprintf(stderr, "%s: Truncated header\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    // Find the index from the end of the file
+    if (fseeko(fp, -(off_t)(sizeof(index_offset) + sizeof(n_blocks)),
+        SEEK_END) != 0 ||
+        fread(&index_offset, sizeof(index_offset), 1, fp) != 1 ||
+        fread(&n_blocks, sizeof(n_blocks), 1, fp) != 1 ||
+        n_blocks != header->n_blocks)
+    {
+        fprintf(stderr, "%s: Missing index, the container was not "
+            "finished\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    *index = malloc((n_blocks > 0 ? n_blocks : 1)*sizeof(container_entry));
+
+    if (fseeko(fp, index_offset, SEEK_SET) != 0 ||
+        fread(*index, sizeof(container_entry), n_blocks, fp) !=
+        (size_t)n_blocks)
+    {
+        fprintf(stderr, "%s: Truncated index\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    return fp;
+}
+
+/*
+ * Reads and decompresses the block holding a loop, found in the index by
+ * binary search. The rows are returned in newly allocated memory, or NULL if
+ * the container has no block for the loop.
+ */
+float *container_read(char *filename, FILE *fp, container_header *header,
+    container_entry *index, long long loop)
+{
+    container_entry key;
+    container_entry *entry;
+
+    key.loop = loop;
+    entry = bsearch(&key, index, header->n_blocks, sizeof(container_entry),
+        container_compare);
+
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+
+    void *block = malloc(entry->size);
+    float *rows = malloc(entry->raw_size);
+
+    if (fseeko(fp, entry->offset, SEEK_SET) != 0 ||
+        fread(block, 1, entry->size, fp) != (size_t)entry->size ||
+        decompress_block(block, entry->size, rows, entry->raw_size,
+        sizeof(float)) != 0)
+    {
+        fprintf(stderr, "%s: Corrupt block for loop %lld\n", filename, loop);
+        exit(EXIT_FAILURE);
+    }
+
+    free(block);
+
+    return rows;
+}
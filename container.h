@@ -0,0 +1,26 @@
+#define CONTAINER_MAGIC     "CLAUTOBC"
+#define CONTAINER_VERSION   1
+
+// Where each block of a container is, looked up by loop
+typedef struct
+{
+    long long   loop;           // Loop the block holds
+    long long   offset;         // Byte offset of the block in the file
+    long long   size;           // Compressed size in bytes
+    long long   raw_size;       // Uncompressed size in bytes
+} container_entry;
+
+typedef struct
+{
+    int         row_length;     // Floats per row
+    int         rows;           // Rows per block
+    long long   n_blocks;       // Number of blocks
+} container_header;
+
+FILE *container_create(char *filename, container_header *header);
+void container_finish(char *filename, FILE *fp, container_header *header,
+    container_entry *index);
+FILE *container_open(char *filename, container_header *header,
+    container_entry **index);
+float *container_read(char *filename, FILE *fp, container_header *header,
+    container_entry *index, long long loop);
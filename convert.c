@@ -4,16 +4,57 @@
 #include "main.h"
 #include "cl_abstractions.h"
 #include "cl_error.h"
+#include "trace.h"
 #include "convert.h"
 
 #define HI_MAG 3.3359
 
-cl_kernel *convert_kernel;
+WORKER_LOCAL cl_kernel *convert_kernel;
 
+// Work sizes and bound buffers, computed once and reused every loop
+WORKER_LOCAL size_t  convert_global_size[1];
+WORKER_LOCAL size_t  convert_local_size[1];
+WORKER_LOCAL cl_mem  convert_input;
+WORKER_LOCAL cl_mem  convert_data;
+WORKER_LOCAL int     convert_offset;
+
+/*
+ * Fills in the value of each 2-bit code according to the encoding scheme.
+ */
+void convert_lut(ga_settings *settings, float *lut)
+{
+    if (settings->bps == 2 && settings->encoding == ENC_VLBA)
+    {
+        // 2-bit VLBA
+        lut[0] = -HI_MAG;
+        lut[1] = 1.0;
+        lut[2] = -1.0;
+        lut[3] = HI_MAG;
+    }
+    else if (settings->bps == 2 && settings->encoding == ENC_AT)
+    {
+        // 2-bit AT
+        lut[0] = 1.0;
+        lut[1] = -1.0;
+        lut[2] = HI_MAG;
+        lut[3] = -HI_MAG;
+    }
+    else
+    {
+        fprintf(stderr, "Unknown encoding\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Builds the convert kernel and sets everything which does not change between
+ * loops: the work size, the LUT and the samples per channel.
+ */
 void convert_initialise(ga_settings *settings, cl_vars *cl)
 {
     cl_int      err_ret;
     cl_program  *program;
+    float       lut[4];
 
     // Create the program
     program = malloc(sizeof(cl_program));
@@ -23,59 +64,40 @@ void convert_initialise(ga_settings *settings, cl_vars *cl)
     convert_kernel = malloc(sizeof(cl_kernel));
 
     // Select the kernel based on settings
-    if (settings->channels == 4)
+    if (settings->channels == 4 && settings->packed)
     {
-        cl_create_kernel(cl, program, convert_kernel, "convert_2bit_4chan");
+        cl_create_kernel(cl, program, convert_kernel,
+            "convert_2bit_4chan_packed");
     }
-    else if (settings->channels == 8)
+    else if (settings->channels == 8 && settings->packed)
     {
-        cl_create_kernel(cl, program, convert_kernel, "convert_2bit_8chan");
+        cl_create_kernel(cl, program, convert_kernel,
+            "convert_2bit_8chan_packed");
     }
-}
-
-void convert_module(ga_settings *settings, cl_vars *cl, cl_mem dev_input,
-    cl_mem dev_data)
-{
-    cl_int      err_ret;
-    size_t      global_work_size[1];
-    size_t      local_work_size[1];
-    float       lut[4];
-
-    // Set work size
-    int nt = MIN(settings->spc, cl->max_work_size);
-    global_work_size[0] = settings->spc;
-    local_work_size[0] = nt;
-
-    // Create the LUT according to the encoding scheme
-    if (settings->bps == 2 && settings->encoding == ENC_VLBA)
+    else if (settings->channels == 4)
     {
-        // 2-bit VLBA
-        lut[0] = -HI_MAG;
-        lut[1] = 1.0;
-        lut[2] = -1.0;
-        lut[3] = HI_MAG;
+        cl_create_kernel(cl, program, convert_kernel, "convert_2bit_4chan");
     }
-    else if (settings->bps == 2 && settings->encoding == ENC_AT)
+    else if (settings->channels == 8)
     {
-        // 2-bit AT
-        lut[0] = 1.0;
-        lut[1] = -1.0;
-        lut[2] = HI_MAG;
-        lut[3] = -HI_MAG;
+        cl_create_kernel(cl, program, convert_kernel, "convert_2bit_8chan");
     }
     else
     {
-        fprintf(stderr, "Unknown encoding\n");
+        fprintf(stderr, "Unsupported number of channels: %d\n",
+            settings->channels);
         exit(EXIT_FAILURE);
     }
 
-    // Set kernel arguments
-    err_ret = clSetKernelArg(*convert_kernel, 0, sizeof(dev_input),
-        (void *)&dev_input);
-    check_error(__FILE__, __LINE__, err_ret);
-    err_ret = clSetKernelArg(*convert_kernel, 1, sizeof(dev_data),
-        (void *)&dev_data);
-    check_error(__FILE__, __LINE__, err_ret);
+    // Set work size
+    int nt = MIN(settings->spc, cl->max_work_size);
+    convert_global_size[0] = settings->spc;
+    convert_local_size[0] = nt;
+
+    // Create the LUT according to the encoding scheme
+    convert_lut(settings, lut);
+
+    // Set the kernel arguments which are constant for the whole run
     err_ret = clSetKernelArg(*convert_kernel, 2, nt*sizeof(cl_int), NULL);
     check_error(__FILE__, __LINE__, err_ret);
     err_ret = clSetKernelArg(*convert_kernel, 3, sizeof(lut), (void *)&lut);
@@ -83,9 +105,62 @@ void convert_module(ga_settings *settings, cl_vars *cl, cl_mem dev_input,
     err_ret = clSetKernelArg(*convert_kernel, 4, sizeof(settings->spc),
         (void *)&settings->spc);
     check_error(__FILE__, __LINE__, err_ret);
+    convert_offset = 0;
+    err_ret = clSetKernelArg(*convert_kernel, 5, sizeof(convert_offset),
+        (void *)&convert_offset);
+    check_error(__FILE__, __LINE__, err_ret);
+}
+
+/*
+ * Sets the number of samples into the input buffer at which the convert
+ * kernel starts reading.
+ */
+void convert_set_offset(int offset)
+{
+    cl_int      err_ret;
+
+    if (offset != convert_offset)
+    {
+        err_ret = clSetKernelArg(*convert_kernel, 5, sizeof(offset),
+            (void *)&offset);
+        check_error(__FILE__, __LINE__, err_ret);
+        convert_offset = offset;
+    }
+}
+
+/*
+ * Executes the convert kernel over the given number of consecutive loops of
+ * input. Only the buffer arguments are set here, and only when they differ
+ * from those bound by the previous call.
+ */
+void convert_module(ga_settings *settings, cl_vars *cl, cl_mem dev_input,
+    cl_mem dev_data, int loops)
+{
+    cl_int      err_ret;
+    size_t      global_work_size[1];
+
+    // Rebind the buffers if they have changed
+    if (dev_input != convert_input)
+    {
+        err_ret = clSetKernelArg(*convert_kernel, 0, sizeof(dev_input),
+            (void *)&dev_input);
+        check_error(__FILE__, __LINE__, err_ret);
+        convert_input = dev_input;
+    }
+
+    if (dev_data != convert_data)
+    {
+        err_ret = clSetKernelArg(*convert_kernel, 1, sizeof(dev_data),
+            (void *)&dev_data);
+        check_error(__FILE__, __LINE__, err_ret);
+        convert_data = dev_data;
+    }
 
     // Execute kernel
+    global_work_size[0] = loops*convert_global_size[0];
+    cl_event *event = trace_enqueue_begin("convert");
     err_ret = clEnqueueNDRangeKernel(cl->queue, *convert_kernel, 1, NULL,
-        global_work_size, local_work_size, 0, NULL, NULL);
+        global_work_size, convert_local_size, 0, NULL, event);
+    trace_enqueue_end(event);
     check_error(__FILE__, __LINE__, err_ret);
 }
@@ -1,12 +1,22 @@
+/*
+ * The convert kernels may be launched over several loops of input at once, in
+ * which case each loop is written to its own block of the data buffer. The
+ * input is read starting offset samples into the input buffer, which is used
+ * to apply integer sample delays.
+ */
 __kernel void convert_2bit_4chan(__global const unsigned char *input,
     __global float2 *data,__local unsigned int *scratch,
-    __const float4 lut, __const int spc)
+    __const float4 lut, __const int spc, __const int offset)
 {
 	int idx = get_global_id(0);
 	int local_idx = get_local_id(0);
 
+    // Find the start of this sample's loop in the data buffer
+    int k = idx/spc;
+    int base = k*4*spc + (idx - k*spc);
+
     // Load the time sample into local memory
-    scratch[local_idx] = input[idx];
+    scratch[local_idx] = input[idx + offset];
 
     // Interpet the LUT as an array
     float *lp = (float *)&lut;
@@ -14,20 +24,24 @@ __kernel void convert_2bit_4chan(__global const unsigned char *input,
     // Loop over each channel
     for (int c = 0; c < 4; c++)
     {
-        data[c*spc + idx].x = lp[(scratch[local_idx] >> (2*c)) & 0x03];
-        data[c*spc + idx].y = 0;
+        data[base + c*spc].x = lp[(scratch[local_idx] >> (2*c)) & 0x03];
+        data[base + c*spc].y = 0;
     }
 }
 
 __kernel void convert_2bit_8chan(__global const unsigned short *input,
     __global float2 *data, __local unsigned int *scratch,
-    __const float4 lut, __const int spc)
+    __const float4 lut, __const int spc, __const int offset)
 {
 	int idx = get_global_id(0);
 	int local_idx = get_local_id(0);
 
+    // Find the start of this sample's loop in the data buffer
+    int k = idx/spc;
+    int base = k*8*spc + (idx - k*spc);
+
     // Load the time sample into local memory
-    scratch[local_idx] = input[idx];
+    scratch[local_idx] = input[idx + offset];
 
     // Interpet the LUT as an array
     float *lp = (float *)&lut;
@@ -35,7 +49,62 @@ __kernel void convert_2bit_8chan(__global const unsigned short *input,
     // Loop over each channel
     for (int c = 0; c < 8; c++)
     {
-        data[c*spc + idx].x = lp[(scratch[local_idx] >> (2*c)) & 0x03];
-        data[c*spc + idx].y = 0;
+        data[base + c*spc].x = lp[(scratch[local_idx] >> (2*c)) & 0x03];
+        data[base + c*spc].y = 0;
+    }
+}
+
+/*
+ * Packed variants: each pair of real channels is stored as the real and
+ * imaginary parts of a single complex channel, halving the size of the data
+ * buffer and the number of FFTs. The sum_packed kernel separates the pairs.
+ */
+__kernel void convert_2bit_4chan_packed(__global const unsigned char *input,
+    __global float2 *data,__local unsigned int *scratch,
+    __const float4 lut, __const int spc, __const int offset)
+{
+	int idx = get_global_id(0);
+	int local_idx = get_local_id(0);
+
+    // Find the start of this sample's loop in the data buffer
+    int k = idx/spc;
+    int base = k*2*spc + (idx - k*spc);
+
+    // Load the time sample into local memory
+    scratch[local_idx] = input[idx + offset];
+
+    // Interpet the LUT as an array
+    float *lp = (float *)&lut;
+
+    // Loop over each pair of channels
+    for (int p = 0; p < 2; p++)
+    {
+        data[base + p*spc].x = lp[(scratch[local_idx] >> (4*p)) & 0x03];
+        data[base + p*spc].y = lp[(scratch[local_idx] >> (4*p + 2)) & 0x03];
+    }
+}
+
+__kernel void convert_2bit_8chan_packed(__global const unsigned short *input,
+    __global float2 *data, __local unsigned int *scratch,
+    __const float4 lut, __const int spc, __const int offset)
+{
+	int idx = get_global_id(0);
+	int local_idx = get_local_id(0);
+
+    // Find the start of this sample's loop in the data buffer
+    int k = idx/spc;
+    int base = k*4*spc + (idx - k*spc);
+
+    // Load the time sample into local memory
+    scratch[local_idx] = input[idx + offset];
+
+    // Interpet the LUT as an array
+    float *lp = (float *)&lut;
+
+    // Loop over each pair of channels
+    for (int p = 0; p < 4; p++)
+    {
+        data[base + p*spc].x = lp[(scratch[local_idx] >> (4*p)) & 0x03];
+        data[base + p*spc].y = lp[(scratch[local_idx] >> (4*p + 2)) & 0x03];
     }
 }
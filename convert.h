@@ -1,3 +1,5 @@
+void convert_lut(ga_settings *settings, float *lut);
 void convert_initialise(ga_settings *settings, cl_vars *cl);
 void convert_module(ga_settings *settings, cl_vars *cl, cl_mem dev_input,
-    cl_mem dev_data);
+    cl_mem dev_data, int loops);
+void convert_set_offset(int offset);
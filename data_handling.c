@@ -1,10 +1,16 @@
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/types.h>
 
 #include "main.h"
 #include "data_handling.h"
+#include "mark6.h"
 
 FILE *fp;
+FILE *fp2;
 
 /*
  * Depending on the input method, opens the file or sets up the network socket
@@ -28,6 +34,95 @@ void input_initialise(ga_settings *settings)
     {
         // TODO: Network initialisation
     }
+    else if (settings->input_type == INPUT_MARK6)
+    {
+        // Start reading from every disk of the recording
+        mark6_open(settings);
+    }
+
+    // Skip to the requested offset
+    if (settings->offset != 0)
+    {
+        input_skip(settings, settings->offset);
+    }
+
+    // Open the second input used for cross-correlation
+    if (settings->input2_file != NULL)
+    {
+        fp2 = fopen(settings->input2_file, "r");
+
+        if (fp2 == NULL)
+        {
+            fprintf(stderr, "%s: ", settings->input2_file);
+            perror("");
+            exit(EXIT_FAILURE);
+        }
+
+        if (fseeko(fp2, (off_t)settings->offset, SEEK_SET) != 0)
+        {
+            fprintf(stderr, "%s: ", settings->input2_file);
+            perror("");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/*
+ * Stops any input threads once no more data is needed
+ */
+void input_terminate(ga_settings *settings)
+{
+    if (settings->input_type == INPUT_MARK6)
+    {
+        mark6_close();
+    }
+}
+
+/*
+ * Skips n_bytes of the input. Files are seeked directly, while stdin is read
+ * and discarded one loop at a time.
+ */
+void input_skip(ga_settings *settings, long long n_bytes)
+{
+    if (settings->input_type == INPUT_FILE)
+    {
+        if (fseeko(fp, (off_t)n_bytes, SEEK_SET) != 0)
+        {
+            fprintf(stderr, "%s: ", settings->input_file);
+            perror("");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (settings->input_type == INPUT_MARK6)
+    {
+        // Discard whole loops from the reassembled stream
+        for (long long i = 0; i < n_bytes; i += settings->bytes)
+        {
+            if (mark6_read(NULL, settings->bytes) != settings->bytes)
+            {
+                fprintf(stderr, "Reached EOF before offset of %lld bytes\n",
+                    n_bytes);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    else if (settings->input_type == INPUT_STDIN)
+    {
+        unsigned int *discard = malloc(settings->bytes);
+
+        for (long long i = 0; i < n_bytes; i += settings->bytes)
+        {
+            if (read_data_file(stdin, discard, settings->bytes) !=
+                settings->bytes)
+            {
+                fprintf(stderr, "Reached EOF before offset of %lld bytes\n",
+                    n_bytes);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        free(discard);
+    }
 }
 
 /*
@@ -52,10 +147,23 @@ int read_data(ga_settings *settings, unsigned int *h_data, int n_bytes)
         // TODO: Read the data from the network
         // read_data_network()
     }
+    else if (settings->input_type == INPUT_MARK6)
+    {
+        // Read the data reassembled from the disks
+        r_bytes = mark6_read(h_data, n_bytes);
+    }
 
     return r_bytes;
 }
 
+/*
+ * Attempts to read n_bytes from the second input
+ */
+int read_data_input2(ga_settings *settings, unsigned int *h_data, int n_bytes)
+{
+    return read_data_file(fp2, h_data, n_bytes);
+}
+
 /*
  * Reads the header from the input
  */
@@ -1,4 +1,7 @@
 void input_initialise(ga_settings *settings);
+void input_terminate(ga_settings *settings);
+void input_skip(ga_settings *settings, long long n_bytes);
 int read_data(ga_settings *settings, unsigned int *h_data, int n_bytes);
+int read_data_input2(ga_settings *settings, unsigned int *h_data, int n_bytes);
 int read_header();
 int read_data_file(FILE *fp, unsigned int *h_data, int n_bytes);
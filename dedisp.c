@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <CL/opencl.h>
+
+#include "main.h"
+#include "cl_abstractions.h"
+#include "cl_error.h"
+#include "trace.h"
+#include "dedisp.h"
+
+// Dispersion constant in seconds for frequencies in MHz and DMs in pc cm^-3
+#define DEDISP_K        4148.808
+
+// Fine trial DMs sharing each coarse DM of the first stage
+#define DEDISP_COARSE   8
+
+// Widest boxcar searched, in waterfall rows
+#define DEDISP_MAX_WIDTH    32
+
+WORKER_LOCAL cl_kernel *subbands_kernel;
+WORKER_LOCAL cl_kernel *dedisperse_kernel;
+WORKER_LOCAL cl_kernel *boxcar_kernel;
+
+// Ring of the most recent waterfall rows, and the intermediate results
+WORKER_LOCAL cl_mem     dedisp_rows;
+WORKER_LOCAL cl_mem     dedisp_subbands;
+WORKER_LOCAL cl_mem     dedisp_series;
+WORKER_LOCAL cl_mem     dedisp_candidates;
+WORKER_LOCAL cl_mem     dedisp_stats;
+WORKER_LOCAL cl_float4  *dedisp_host_candidates;
+
+WORKER_LOCAL int        dedisp_history;     // Rows kept from earlier launches
+WORKER_LOCAL int        dedisp_ring_rows;   // Rows in the ring
+WORKER_LOCAL int        dedisp_max_inter;   // Longest delay between channels
+WORKER_LOCAL long long  dedisp_rows_seen;   // Rows added to the ring so far
+WORKER_LOCAL double     dedisp_n_seen;      // Samples in the statistics
+
+// Shared by all workers, although only one may dedisperse
+FILE *dedisp_fp = NULL;
+
+/*
+ * Returns the delay in seconds of frequency f relative to f_ref at a DM.
+ */
+double dedisp_delay(double dm, double f, double f_ref)
+{
+    return DEDISP_K*dm*(1/(f*f) - 1/(f_ref*f_ref));
+}
+
+/*
+ * Opens the trigger file, which has one line per candidate.
+ */
+void dedisp_open(ga_settings *settings)
+{
+    dedisp_fp = fopen(settings->trigger_file, "w");
+
+    if (dedisp_fp == NULL)
+    {
+        fprintf(stderr, "%s: ", settings->trigger_file);
+        perror("");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(dedisp_fp, "# Time (s), DM (pc cm^-3), width (s), S/N\n");
+    fflush(dedisp_fp);
+}
+
+void dedisp_close(void)
+{
+    if (dedisp_fp != NULL)
+    {
+        fclose(dedisp_fp);
+    }
+}
+
+/*
+ * Builds the dedispersion kernels, works out the delay of every bin for each
+ * trial DM, and creates the buffers for up to superbatch loops of rows.
+ *
+ * The band is taken to be the channels side by side, channel c covering
+ * freq + c*channel_width to freq + (c + 1)*channel_width MHz. The first stage
+ * sums the bins of each channel along the curve of every DEDISP_COARSE-th
+ * DM, relative to the top of the channel. The second stage shifts those
+ * channel series by each fine DM's delay between the channels. This costs
+ * DEDISP_COARSE times less than dedispersing each DM directly, for a
+ * smearing of at most DEDISP_COARSE/2 DM steps within a channel.
+ */
+void dedisp_initialise(ga_settings *settings, cl_vars *cl, int superbatch)
+{
+    cl_int      err_ret;
+    cl_program  *program;
+    int         channels = settings->channels;
+    int         row_length = settings->output_length;
+    int         bins = row_length/channels;
+    double      row_time = (double)settings->decimate*settings->bins/
+        settings->rate;
+    double      f_top = settings->freq + channels*settings->channel_width;
+    int         n_coarse = (settings->n_dm + DEDISP_COARSE - 1)/DEDISP_COARSE;
+    int         max_intra = 0;
+
+    // Create the program
+    program = malloc(sizeof(cl_program));
+    cl_create_program(cl, program, "dedisp.cl");
+
+    // Create the kernels
+    subbands_kernel = malloc(sizeof(cl_kernel));
+    cl_create_kernel(cl, program, subbands_kernel, "dedisperse_subbands");
+    dedisperse_kernel = malloc(sizeof(cl_kernel));
+    cl_create_kernel(cl, program, dedisperse_kernel, "dedisperse");
+    boxcar_kernel = malloc(sizeof(cl_kernel));
+    cl_create_kernel(cl, program, boxcar_kernel, "boxcar");
+
+    // Delays of each bin within its channel at the middle of each coarse DM
+    // group, and of each channel within the band at each fine DM, in rows
+    int *intra = malloc((size_t)n_coarse*row_length*sizeof(int));
+    int *inter = malloc((size_t)settings->n_dm*channels*sizeof(int));
+
+    for (int k = 0; k < n_coarse; k++)
+    {
+        double dm = settings->dm_low +
+            (k*DEDISP_COARSE + DEDISP_COARSE/2)*settings->dm_step;
+
+        for (int j = 0; j < row_length; j++)
+        {
+            int c = j/bins;
+            double f = settings->freq + (c + (j%bins + 0.5)/bins)*
+                settings->channel_width;
+            double f_ref = settings->freq + (c + 1)*settings->channel_width;
+
+            intra[k*row_length + j] = (int)(dedisp_delay(dm, f, f_ref)/
+                row_time + 0.5);
+            max_intra = MAX(max_intra, intra[k*row_length + j]);
+        }
+    }
+
+    dedisp_max_inter = 0;
+
+    for (int d = 0; d < settings->n_dm; d++)
+    {
+        double dm = settings->dm_low + d*settings->dm_step;
+
+        for (int c = 0; c < channels; c++)
+        {
+            double f = settings->freq + (c + 1)*settings->channel_width;
+
+            inter[d*channels + c] = (int)(dedisp_delay(dm, f, f_top)/
+                row_time + 0.5);
+            dedisp_max_inter = MAX(dedisp_max_inter, inter[d*channels + c]);
+        }
+    }
+
+    // Enough rows are kept from earlier launches to dedisperse and search
+    // every row of a launch
+    int launch_rows = superbatch*settings->waterfall_rows;
+    dedisp_history = max_intra + dedisp_max_inter + DEDISP_MAX_WIDTH - 1;
+    dedisp_ring_rows = dedisp_history + launch_rows;
+    dedisp_rows_seen = 0;
+    dedisp_n_seen = 0;
+
+    int sub_length = launch_rows + DEDISP_MAX_WIDTH - 1 + dedisp_max_inter;
+    int series_length = launch_rows + DEDISP_MAX_WIDTH - 1;
+
+    fprintf(stderr, "Dedispersion: %d DMs from %.3lf to %.3lf, %d coarse, "
+        "%.6lf s rows, %d rows of history\n", settings->n_dm,
+        settings->dm_low, settings->dm_low +
+        (settings->n_dm - 1)*settings->dm_step, n_coarse, row_time,
+        dedisp_history);
+
+    // Create the buffers, starting from an empty ring and no statistics
+    float *zeros = calloc((size_t)dedisp_ring_rows*row_length, sizeof(float));
+
+    dedisp_rows = clCreateBuffer(cl->context,
+        CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+        (size_t)dedisp_ring_rows*row_length*sizeof(float), zeros, &err_ret);
+    check_error(__FILE__, __LINE__, err_ret);
+    free(zeros);
+
+    zeros = calloc(settings->n_dm, sizeof(cl_float2));
+    dedisp_stats = clCreateBuffer(cl->context,
+        CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+        settings->n_dm*sizeof(cl_float2), zeros, &err_ret);
+    check_error(__FILE__, __LINE__, err_ret);
+    free(zeros);
+
+    dedisp_subbands = clCreateBuffer(cl->context, CL_MEM_READ_WRITE,
+        (size_t)n_coarse*channels*sub_length*sizeof(float), NULL, &err_ret);
+    check_error(__FILE__, __LINE__, err_ret);
+    dedisp_series = clCreateBuffer(cl->context, CL_MEM_READ_WRITE,
+        (size_t)settings->n_dm*series_length*sizeof(float), NULL, &err_ret);
+    check_error(__FILE__, __LINE__, err_ret);
+    dedisp_candidates = clCreateBuffer(cl->context, CL_MEM_WRITE_ONLY,
+        settings->n_dm*sizeof(cl_float4), NULL, &err_ret);
+    check_error(__FILE__, __LINE__, err_ret);
+    dedisp_host_candidates = malloc(settings->n_dm*sizeof(cl_float4));
+
+    cl_mem dev_intra = clCreateBuffer(cl->context,
+        CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+        (size_t)n_coarse*row_length*sizeof(int), intra, &err_ret);
+    check_error(__FILE__, __LINE__, err_ret);
+    cl_mem dev_inter = clCreateBuffer(cl->context,
+        CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+        (size_t)settings->n_dm*channels*sizeof(int), inter, &err_ret);
+    check_error(__FILE__, __LINE__, err_ret);
+    free(intra);
+    free(inter);
+
+    // Set the kernel arguments which are constant for the whole run
+    int coarse = DEDISP_COARSE;
+    int max_width = DEDISP_MAX_WIDTH;
+
+    err_ret = clSetKernelArg(*subbands_kernel, 0, sizeof(dedisp_rows),
+        (void *)&dedisp_rows);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*subbands_kernel, 1, sizeof(dedisp_subbands),
+        (void *)&dedisp_subbands);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*subbands_kernel, 2, sizeof(dev_intra),
+        (void *)&dev_intra);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*subbands_kernel, 3, sizeof(dedisp_ring_rows),
+        (void *)&dedisp_ring_rows);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*subbands_kernel, 5, sizeof(row_length),
+        (void *)&row_length);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    err_ret = clSetKernelArg(*dedisperse_kernel, 0, sizeof(dedisp_subbands),
+        (void *)&dedisp_subbands);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*dedisperse_kernel, 1, sizeof(dedisp_series),
+        (void *)&dedisp_series);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*dedisperse_kernel, 2, sizeof(dev_inter),
+        (void *)&dev_inter);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*dedisperse_kernel, 3, sizeof(channels),
+        (void *)&channels);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*dedisperse_kernel, 4, sizeof(coarse),
+        (void *)&coarse);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    err_ret = clSetKernelArg(*boxcar_kernel, 0, sizeof(dedisp_series),
+        (void *)&dedisp_series);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*boxcar_kernel, 1, sizeof(dedisp_candidates),
+        (void *)&dedisp_candidates);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*boxcar_kernel, 2, sizeof(dedisp_stats),
+        (void *)&dedisp_stats);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*boxcar_kernel, 6, sizeof(max_width),
+        (void *)&max_width);
+    check_error(__FILE__, __LINE__, err_ret);
+}
+
+/*
+ * Adds the waterfall rows of the given number of consecutive loops, starting
+ * at loop, to the ring, dedisperses them at every trial DM and searches each
+ * DM for a boxcar above the S/N threshold. The best candidate of each DM is
+ * written to the trigger file as soon as it is found. The loops must arrive
+ * in order.
+ */
+void dedisp_module(ga_settings *settings, cl_vars *cl, cl_mem dev_waterfall,
+    long long loop, int loops)
+{
+    cl_int      err_ret;
+    size_t      global_work_size[3];
+    int         row_length = settings->output_length;
+    int         rows = loops*settings->waterfall_rows;
+    size_t      row_bytes = row_length*sizeof(float);
+
+    // Copy the rows into the ring, in two parts if they wrap around its end
+    int head = dedisp_rows_seen%dedisp_ring_rows;
+    int part = MIN(rows, dedisp_ring_rows - head);
+
+    err_ret = clEnqueueCopyBuffer(cl->queue, dev_waterfall, dedisp_rows, 0,
+        head*row_bytes, part*row_bytes, 0, NULL, NULL);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    if (part < rows)
+    {
+        err_ret = clEnqueueCopyBuffer(cl->queue, dev_waterfall, dedisp_rows,
+            part*row_bytes, 0, (rows - part)*row_bytes, 0, NULL, NULL);
+        check_error(__FILE__, __LINE__, err_ret);
+    }
+
+    // Time 0 of the series is the oldest row kept, and boxcars may not start
+    // before the first row of the stream
+    long long start = dedisp_rows_seen - dedisp_history;
+    int base = (int)(((start%dedisp_ring_rows) + dedisp_ring_rows)%
+        dedisp_ring_rows);
+    int first = (int)MAX(0, -start);
+    int series_length = rows + DEDISP_MAX_WIDTH - 1;
+    int sub_length = series_length + dedisp_max_inter;
+    float n_seen = dedisp_n_seen;
+
+    dedisp_rows_seen += rows;
+
+    // Sum the bins of each channel at each coarse DM
+    err_ret = clSetKernelArg(*subbands_kernel, 4, sizeof(base),
+        (void *)&base);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    global_work_size[0] = sub_length;
+    global_work_size[1] = settings->channels;
+    global_work_size[2] = (settings->n_dm + DEDISP_COARSE - 1)/DEDISP_COARSE;
+    cl_event *event = trace_enqueue_begin("dedisperse_subbands");
+    err_ret = clEnqueueNDRangeKernel(cl->queue, *subbands_kernel, 3, NULL,
+        global_work_size, NULL, 0, NULL, event);
+    trace_enqueue_end(event);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    // Sum the channels at each fine DM
+    err_ret = clSetKernelArg(*dedisperse_kernel, 5, sizeof(sub_length),
+        (void *)&sub_length);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    global_work_size[0] = series_length;
+    global_work_size[1] = settings->n_dm;
+    event = trace_enqueue_begin("dedisperse");
+    err_ret = clEnqueueNDRangeKernel(cl->queue, *dedisperse_kernel, 2, NULL,
+        global_work_size, NULL, 0, NULL, event);
+    trace_enqueue_end(event);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    // Search each DM for the brightest boxcar
+    err_ret = clSetKernelArg(*boxcar_kernel, 3, sizeof(series_length),
+        (void *)&series_length);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*boxcar_kernel, 4, sizeof(rows), (void *)&rows);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*boxcar_kernel, 5, sizeof(first),
+        (void *)&first);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*boxcar_kernel, 7, sizeof(n_seen),
+        (void *)&n_seen);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    global_work_size[0] = settings->n_dm;
+    event = trace_enqueue_begin("boxcar");
+    err_ret = clEnqueueNDRangeKernel(cl->queue, *boxcar_kernel, 1, NULL,
+        global_work_size, NULL, 0, NULL, event);
+    trace_enqueue_end(event);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    if (first < rows)
+    {
+        dedisp_n_seen += rows - first;
+    }
+
+    // Copy the candidates back and report those above the threshold
+    err_ret = clEnqueueReadBuffer(cl->queue, dedisp_candidates, CL_TRUE, 0,
+        settings->n_dm*sizeof(cl_float4), dedisp_host_candidates, 0, NULL,
+        NULL);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    double row_time = (double)settings->decimate*settings->bins/
+        settings->rate;
+    long long row0 = (settings->offset/settings->bytes + loop)*
+        settings->waterfall_rows;
+
+    for (int d = 0; d < settings->n_dm; d++)
+    {
+        cl_float4 *c = &dedisp_host_candidates[d];
+
+        if (c->s[0] >= settings->snr_threshold)
+        {
+            // The series starts dedisp_history rows before the first new row
+            long long row = row0 - dedisp_history + (long long)c->s[1];
+
+            fprintf(dedisp_fp, "%.6lf %.3lf %.6lf %.2f\n", row*row_time,
+                settings->dm_low + d*settings->dm_step, c->s[2]*row_time,
+                c->s[0]);
+        }
+    }
+
+    fflush(dedisp_fp);
+}
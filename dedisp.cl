@@ -0,0 +1,122 @@
+/*
+ * First stage of the sub-band dedispersion. The bins of each channel are
+ * summed along the dispersion curve of a coarse trial DM, giving one time
+ * series per channel and coarse DM. The rows are held in a ring of n_rows
+ * rows, with time 0 at row base. The dimensions run over time, channels and
+ * coarse DMs.
+ */
+__kernel void dedisperse_subbands(__global const float *rows,
+    __global float *subbands, __global const int *delays, __const int n_rows,
+    __const int base, __const int row_length)
+{
+    int t = get_global_id(0);
+    int c = get_global_id(1);
+    int k = get_global_id(2);
+    int length = get_global_size(0);
+    int channels = get_global_size(1);
+    int bins = row_length/channels;
+
+    float x = 0;
+    for (int j = c*bins; j < (c + 1)*bins; j++)
+    {
+        int r = (base + t + delays[k*row_length + j])%n_rows;
+        x += rows[r*row_length + j];
+    }
+
+    subbands[(k*channels + c)*length + t] = x;
+}
+
+/*
+ * Second stage of the sub-band dedispersion. The channel time series of the
+ * nearest coarse DM are shifted by the delay of each channel at the fine trial
+ * DM and summed. The dimensions run over time and fine DMs.
+ */
+__kernel void dedisperse(__global const float *subbands,
+    __global float *series, __global const int *delays, __const int channels,
+    __const int coarse, __const int sub_length)
+{
+    int t = get_global_id(0);
+    int d = get_global_id(1);
+    int k = d/coarse;
+
+    float x = 0;
+    for (int c = 0; c < channels; c++)
+    {
+        x += subbands[(k*channels + c)*sub_length + t +
+            delays[d*channels + c]];
+    }
+
+    series[d*get_global_size(0) + t] = x;
+}
+
+/*
+ * Searches the dedispersed time series of one DM for the boxcar of 1, 2, 4,
+ * ... up to max_width samples with the highest signal to noise, starting
+ * within the first rows samples but not before first. The mean and variance
+ * are accumulated over every launch, in stats, from the n_seen samples of
+ * earlier launches and those of this one. The best candidate is written as
+ * (S/N, start, width).
+ */
+__kernel void boxcar(__global const float *series, __global float4 *candidates,
+    __global float2 *stats, __const int length, __const int rows,
+    __const int first, __const int max_width, __const float n_seen)
+{
+    int d = get_global_id(0);
+    __global const float *x = series + d*length;
+
+    // Merge the statistics of this launch with those of the earlier ones
+    float n = rows - first;
+    float mean = 0;
+    float m2 = 0;
+
+    for (int t = first; t < rows; t++)
+    {
+        mean += x[t];
+    }
+    mean /= max(n, 1.0f);
+
+    for (int t = first; t < rows; t++)
+    {
+        m2 += (x[t] - mean)*(x[t] - mean);
+    }
+
+    float2 s = stats[d];
+    if (n > 0)
+    {
+        float delta = mean - s.x;
+        float total = n_seen + n;
+        s.x += delta*n/total;
+        s.y += m2 + delta*delta*n_seen*n/total;
+        stats[d] = s;
+    }
+
+    float sigma = sqrt(s.y/max(n_seen + n - 1, 1.0f));
+    float4 best = (float4)(0, 0, 0, 0);
+
+    for (int w = 1; w <= max_width && n > 0 && sigma > 0; w *= 2)
+    {
+        float sum = 0;
+        for (int t = first; t < first + w; t++)
+        {
+            sum += x[t];
+        }
+
+        for (int t = first; t < rows; t++)
+        {
+            // Slide the boxcar along by one sample
+            if (t > first)
+            {
+                sum += x[t + w - 1] - x[t - 1];
+            }
+
+            float snr = (sum - w*s.x)/(sigma*sqrt((float)w));
+
+            if (snr > best.x)
+            {
+                best = (float4)(snr, t, w, 0);
+            }
+        }
+    }
+
+    candidates[d] = best;
+}
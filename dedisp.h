@@ -0,0 +1,5 @@
+void dedisp_open(ga_settings *settings);
+void dedisp_close(void);
+void dedisp_initialise(ga_settings *settings, cl_vars *cl, int superbatch);
+void dedisp_module(ga_settings *settings, cl_vars *cl, cl_mem dev_waterfall,
+    long long loop, int loops);
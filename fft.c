@@ -1,43 +1,92 @@
 #include <math.h>
+#include <stdlib.h>
 #include <CL/opencl.h>
 
 #include "main.h"
 #include "cl_abstractions.h"
 #include "cl_error.h"
+#include "trace.h"
 #include "fft.h"
 #include "clAppleFft.h"
 
-clFFT_Plan plan;
+WORKER_LOCAL clFFT_Plan plan;
+WORKER_LOCAL int        n_fft;
+
+// Plans of the additional resolutions, which transform out of place so that
+// the converted data is left for the others
+WORKER_LOCAL clFFT_Plan *resolution_plans;
 
 /*
- * Creates the FFT plan in an initialisation routine so that so that it doesn't
- * need to be performed every loop.
+ * Creates an FFT plan of the given number of bins.
  */
-void fft_initialise(ga_settings *settings, cl_vars *cl)
+clFFT_Plan fft_create_plan(cl_vars *cl, int bins)
 {
     cl_int      err_ret;
+    clFFT_Plan  new_plan;
 
     // Set the FFT dimension
-    clFFT_Dim3  dim = {settings->bins, 1, 1};
+    clFFT_Dim3  dim = {bins, 1, 1};
 
     // Create FFT plan
-    plan = clFFT_CreatePlan(cl->context, dim, clFFT_1D, 
+    new_plan = clFFT_CreatePlan(cl->context, dim, clFFT_1D, 
             clFFT_InterleavedComplexFormat, &err_ret);
     check_error(__FILE__, __LINE__, err_ret);
+
+    return new_plan;
+}
+
+/*
+ * Creates the FFT plan in an initialisation routine so that so that it doesn't
+ * need to be performed every loop.
+ */
+void fft_initialise(ga_settings *settings, cl_vars *cl)
+{
+    plan = fft_create_plan(cl, settings->bins);
+
+    // Determine the number of FFTs to be performed each loop
+    n_fft = (settings->data_length)/(settings->bins);
+
+    if (settings->n_resolutions > 0)
+    {
+        resolution_plans = malloc(settings->n_resolutions*sizeof(clFFT_Plan));
+
+        for (int r = 0; r < settings->n_resolutions; r++)
+        {
+            resolution_plans[r] = fft_create_plan(cl, settings->resolutions[r]);
+        }
+    }
 }
 
 /*
- * Executes the FFT using the plan.
+ * Executes the FFT of additional resolution r over the given number of
+ * consecutive loops, from the converted data in dev_data into dev_out. This
+ * must come before fft_module, which transforms dev_data in place.
  */
-void fft_module(ga_settings *settings, cl_vars *cl, cl_mem dev_data)
+void fft_resolution_module(ga_settings *settings, cl_vars *cl, int r,
+    cl_mem dev_data, cl_mem dev_out, int loops)
 {
     cl_int  err_ret;
+    int     n = (settings->data_length)/(settings->resolutions[r]);
+
+    // Execute the FFT
+    cl_event *event = trace_enqueue_begin("fft_resolution");
+    err_ret = clFFT_ExecuteInterleaved(cl->queue, resolution_plans[r],
+        loops*n, clFFT_Forward, dev_data, dev_out, 0, 0, event);
+    trace_enqueue_end(event);
+    check_error(__FILE__, __LINE__, err_ret);
+}
 
-    // Determine the number of FFTs to be performed
-    int     n_fft = (settings->channels)*(settings->batch_size);
+/*
+ * Executes the FFT using the plan, over the given number of consecutive loops.
+ */
+void fft_module(ga_settings *settings, cl_vars *cl, cl_mem dev_data, int loops)
+{
+    cl_int  err_ret;
 
     // Execute the FFT
-    err_ret = clFFT_ExecuteInterleaved(cl->queue, plan, n_fft, clFFT_Forward,
-        dev_data, dev_data, 0, 0, 0);  
+    cl_event *event = trace_enqueue_begin("fft");
+    err_ret = clFFT_ExecuteInterleaved(cl->queue, plan, loops*n_fft,
+        clFFT_Forward, dev_data, dev_data, 0, 0, event);
+    trace_enqueue_end(event);
     check_error(__FILE__, __LINE__, err_ret);
 }
@@ -1,2 +1,5 @@
 void fft_initialise(ga_settings *settings, cl_vars *cl);
-void fft_module(ga_settings *settings, cl_vars *cl, cl_mem dev_data);
+void fft_module(ga_settings *settings, cl_vars *cl, cl_mem dev_data,
+    int loops);
+void fft_resolution_module(ga_settings *settings, cl_vars *cl, int r,
+    cl_mem dev_data, cl_mem dev_out, int loops);
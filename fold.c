@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <CL/opencl.h>
+
+#include "main.h"
+#include "cl_abstractions.h"
+#include "cl_error.h"
+#include "trace.h"
+#include "fold.h"
+
+// Terms of the ephemeris kept for each loop, enough for a loop of any
+// practical length
+#define FOLD_TERMS  4
+
+WORKER_LOCAL cl_kernel *fold_kernel;
+
+// Work sizes and bound buffers, computed once and reused every loop
+WORKER_LOCAL size_t     fold_global_size[1];
+WORKER_LOCAL size_t     fold_local_size[1];
+WORKER_LOCAL cl_mem     fold_data;
+WORKER_LOCAL cl_mem     fold_output;
+WORKER_LOCAL cl_mem     fold_counts;
+WORKER_LOCAL cl_mem     fold_terms;
+WORKER_LOCAL cl_float4  *fold_host_terms;
+WORKER_LOCAL int        fold_loops;
+
+/*
+ * Builds the fold kernel and sets the arguments which do not change between
+ * loops. The ephemeris buffer holds the terms of up to superbatch loops.
+ */
+void fold_initialise(ga_settings *settings, cl_vars *cl, int superbatch)
+{
+    cl_int      err_ret;
+    cl_program  *program;
+    cl_float    frame_time = settings->bins/settings->rate;
+
+    // Create the program
+    program = malloc(sizeof(cl_program));
+    cl_create_program(cl, program, "fold.cl");
+
+    // Create the kernel
+    fold_kernel = malloc(sizeof(cl_kernel));
+
+    if (settings->packed)
+    {
+        cl_create_kernel(cl, program, fold_kernel, "fold_packed");
+    }
+    else
+    {
+        cl_create_kernel(cl, program, fold_kernel, "fold");
+    }
+
+    // Set work size
+    int nt = MIN(settings->output_length, cl->max_work_size);
+    fold_global_size[0] = settings->output_length;
+    fold_local_size[0] = nt;
+
+    fold_host_terms = malloc(superbatch*sizeof(cl_float4));
+    fold_terms = clCreateBuffer(cl->context, CL_MEM_READ_ONLY,
+        superbatch*sizeof(cl_float4), NULL, &err_ret);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    // Set the kernel arguments which are constant for the whole run
+    err_ret = clSetKernelArg(*fold_kernel, 3, sizeof(fold_terms),
+        (void *)&fold_terms);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*fold_kernel, 4, sizeof(settings->batch_size),
+        (void *)&settings->batch_size);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*fold_kernel, 5, sizeof(settings->spc),
+        (void *)&settings->spc);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*fold_kernel, 6, sizeof(settings->bins),
+        (void *)&settings->bins);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*fold_kernel, 8, sizeof(settings->data_length),
+        (void *)&settings->data_length);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*fold_kernel, 9, sizeof(settings->phase_bins),
+        (void *)&settings->phase_bins);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*fold_kernel, 10, sizeof(frame_time),
+        (void *)&frame_time);
+    check_error(__FILE__, __LINE__, err_ret);
+    fold_loops = 0;
+}
+
+/*
+ * Shifts the ephemeris, a polynomial in seconds since the start of the
+ * stream, to the start of a loop. The phase is reduced to a fraction of a
+ * turn, and only the first FOLD_TERMS terms are kept, so the device can
+ * evaluate the phase within the loop in single precision.
+ */
+void fold_shift(ga_settings *settings, long long loop, cl_float4 *terms)
+{
+    double t0 = (double)(settings->offset/settings->bytes + loop)*
+        settings->spc/settings->rate;
+
+    for (int j = 0; j < FOLD_TERMS; j++)
+    {
+        // Sum of c[i]*binomial(i, j)*t0^(i - j) over i >= j
+        double term = 0;
+        double scale = 1;
+
+        for (int i = j; i < settings->n_ephemeris; i++)
+        {
+            term += settings->ephemeris[i]*scale;
+            scale *= t0*(i + 1)/(i + 1 - j);
+        }
+
+        if (j == 0)
+        {
+            term -= floor(term);
+        }
+
+        terms->s[j] = term;
+    }
+}
+
+/*
+ * Folds the given number of consecutive loops, starting at loop, into the
+ * phase-binned spectra in dev_folded, counting the frames of each phase bin in
+ * dev_counts.
+ */
+void fold_module(ga_settings *settings, cl_vars *cl, cl_mem dev_data,
+    cl_mem dev_folded, cl_mem dev_counts, long long loop, int loops)
+{
+    cl_int      err_ret;
+
+    // Rebind the buffers if they have changed
+    if (dev_data != fold_data)
+    {
+        err_ret = clSetKernelArg(*fold_kernel, 0, sizeof(dev_data),
+            (void *)&dev_data);
+        check_error(__FILE__, __LINE__, err_ret);
+        fold_data = dev_data;
+    }
+
+    if (dev_folded != fold_output)
+    {
+        err_ret = clSetKernelArg(*fold_kernel, 1, sizeof(dev_folded),
+            (void *)&dev_folded);
+        check_error(__FILE__, __LINE__, err_ret);
+        fold_output = dev_folded;
+    }
+
+    if (dev_counts != fold_counts)
+    {
+        err_ret = clSetKernelArg(*fold_kernel, 2, sizeof(dev_counts),
+            (void *)&dev_counts);
+        check_error(__FILE__, __LINE__, err_ret);
+        fold_counts = dev_counts;
+    }
+
+    if (loops != fold_loops)
+    {
+        err_ret = clSetKernelArg(*fold_kernel, 7, sizeof(loops),
+            (void *)&loops);
+        check_error(__FILE__, __LINE__, err_ret);
+        fold_loops = loops;
+    }
+
+    // Copy the ephemeris of each loop to the device
+    for (int k = 0; k < loops; k++)
+    {
+        fold_shift(settings, loop + k, &fold_host_terms[k]);
+    }
+
+    err_ret = clEnqueueWriteBuffer(cl->queue, fold_terms, CL_TRUE, 0,
+        loops*sizeof(cl_float4), fold_host_terms, 0, NULL, NULL);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    // Execute kernel
+    cl_event *event = trace_enqueue_begin("fold");
+    err_ret = clEnqueueNDRangeKernel(cl->queue, *fold_kernel, 1, NULL,
+        fold_global_size, fold_local_size, 0, NULL, event);
+    trace_enqueue_end(event);
+    check_error(__FILE__, __LINE__, err_ret);
+}
+
+/*
+ * Writes the folded spectra, phase_bins rows of output_length floats, each
+ * the mean power of the frames which fell in that phase bin.
+ */
+void fold_write(ga_settings *settings, float *folded, int *counts)
+{
+    FILE        *fp;
+    int         min_count = counts[0];
+    int         max_count = counts[0];
+
+    fp = fopen(settings->fold_file, "wb");
+
+    if (fp == NULL)
+    {
+        fprintf(stderr, "%s: ", settings->fold_file);
+        perror("");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int p = 0; p < settings->phase_bins; p++)
+    {
+        float *row = folded + (size_t)p*settings->output_length;
+
+        for (int i = 0; i < settings->output_length; i++)
+        {
+            row[i] = counts[p] > 0 ? row[i]/counts[p] : 0;
+        }
+
+        if (fwrite(row, sizeof(float), settings->output_length, fp) !=
+            (size_t)settings->output_length)
+        {
+            fprintf(stderr, "%s: ", settings->fold_file);
+            perror("");
+            exit(EXIT_FAILURE);
+        }
+
+        min_count = MIN(min_count, counts[p]);
+        max_count = MAX(max_count, counts[p]);
+    }
+
+    fclose(fp);
+
+    fprintf(stderr, "Fold: %d phase bins of %d floats, %d to %d frames per "
+        "bin\n", settings->phase_bins, settings->output_length, min_count,
+        max_count);
+}
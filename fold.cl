@@ -0,0 +1,93 @@
+/*
+ * Returns the phase bin of FFT frame s of a loop. The phase is a cubic in the
+ * time since the start of the loop, whose terms the host has shifted from the
+ * ephemeris to that loop, so single precision is enough.
+ */
+int fold_bin(float4 terms, int s, float frame_time, int phase_bins)
+{
+    float t = (s + 0.5f)*frame_time;
+    float phase = terms.x + t*(terms.y + t*(terms.z + t*terms.w));
+    int bin = (int)((phase - floor(phase))*phase_bins);
+
+    return min(bin, phase_bins - 1);
+}
+
+/*
+ * Folds the power of each FFT frame into the phase bin it falls in. The first
+ * dimension runs over the output spectrum, and each work item adds every frame
+ * of every loop in the launch to its own column of the folded cube, so no two
+ * work items write the same value. The first work item also counts the frames
+ * added to each phase bin.
+ */
+__kernel void fold(__global const float2 *data, __global float *folded,
+    __global int *counts, __global const float4 *terms, __const int batch_size,
+    __const int spc, __const int bins, __const int loops, __const int stride,
+    __const int phase_bins, __const float frame_time)
+{
+    int idx = get_global_id(0);
+    int length = get_global_size(0);
+    int a = (idx/(bins/2))*spc + idx%(bins/2);
+
+    for (int k = 0; k < loops; k++)
+    {
+        for (int s = 0; s < batch_size; s++)
+        {
+            int bin = fold_bin(terms[k], s, frame_time, phase_bins);
+            int d = k*stride + a + s*bins;
+
+            folded[bin*length + idx] +=
+                sqrt(data[d].x*data[d].x + data[d].y*data[d].y);
+
+            if (idx == 0)
+            {
+                counts[bin]++;
+            }
+        }
+    }
+}
+
+/*
+ * Folds the packed data layout, separating each pair of channels in the same
+ * way as sum_packed.
+ */
+__kernel void fold_packed(__global const float2 *data, __global float *folded,
+    __global int *counts, __global const float4 *terms, __const int batch_size,
+    __const int spc, __const int bins, __const int loops, __const int stride,
+    __const int phase_bins, __const float frame_time)
+{
+    int idx = get_global_id(0);
+    int length = get_global_size(0);
+    int c = idx/(bins/2);
+    int j = idx%(bins/2);
+    int a = (c/2)*spc + j;
+    int b = (c/2)*spc + (bins - j)%bins;
+
+    for (int k = 0; k < loops; k++)
+    {
+        for (int s = 0; s < batch_size; s++)
+        {
+            int bin = fold_bin(terms[k], s, frame_time, phase_bins);
+            float2 z = data[k*stride + a + s*bins];
+            float2 w = data[k*stride + b + s*bins];
+            float x;
+
+            if (c%2 == 0)
+            {
+                x = 0.5f*sqrt((z.x + w.x)*(z.x + w.x) +
+                    (z.y - w.y)*(z.y - w.y));
+            }
+            else
+            {
+                x = 0.5f*sqrt((z.x - w.x)*(z.x - w.x) +
+                    (z.y + w.y)*(z.y + w.y));
+            }
+
+            folded[bin*length + idx] += x;
+
+            if (idx == 0)
+            {
+                counts[bin]++;
+            }
+        }
+    }
+}
@@ -0,0 +1,4 @@
+void fold_initialise(ga_settings *settings, cl_vars *cl, int superbatch);
+void fold_module(ga_settings *settings, cl_vars *cl, cl_mem dev_data,
+    cl_mem dev_folded, cl_mem dev_counts, long long loop, int loops);
+void fold_write(ga_settings *settings, float *folded, int *counts);
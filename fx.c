@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <CL/opencl.h>
+
+#include "main.h"
+#include "cl_abstractions.h"
+#include "cl_error.h"
+#include "trace.h"
+#include "fx.h"
+
+WORKER_LOCAL cl_kernel *cross_kernel;
+
+// Work sizes and bound buffers, computed once and reused every loop
+WORKER_LOCAL size_t cross_global_size[1];
+WORKER_LOCAL size_t cross_local_size[1];
+WORKER_LOCAL cl_mem cross_data[2];
+WORKER_LOCAL cl_mem cross_output;
+
+// The delay model, which is read one line per loop
+FILE        *model_fp;
+fx_model    model_last;
+
+/*
+ * Builds the cross kernel, sets the arguments which do not change between
+ * loops and opens the delay model.
+ */
+void fx_initialise(ga_settings *settings, cl_vars *cl)
+{
+    cl_int      err_ret;
+    cl_program  *program;
+
+    // Create the program
+    program = malloc(sizeof(cl_program));
+    cl_create_program(cl, program, "fx.cl");
+
+    // Create the kernel
+    cross_kernel = malloc(sizeof(cl_kernel));
+    cl_create_kernel(cl, program, cross_kernel, "cross");
+
+    // Set work size
+    int nt = MIN(settings->output_length, cl->max_work_size);
+    cross_global_size[0] = settings->output_length;
+    cross_local_size[0] = nt;
+
+    // Set the kernel arguments which are constant for the whole run
+    err_ret = clSetKernelArg(*cross_kernel, 3, sizeof(settings->batch_size),
+        (void *)&settings->batch_size);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*cross_kernel, 4, sizeof(settings->spc),
+        (void *)&settings->spc);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*cross_kernel, 5, sizeof(settings->bins),
+        (void *)&settings->bins);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    // Open the delay model, without one all corrections are zero
+    if (settings->delay_model != NULL)
+    {
+        model_fp = fopen(settings->delay_model, "r");
+
+        if (model_fp == NULL)
+        {
+            fprintf(stderr, "%s: ", settings->delay_model);
+            perror("");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/*
+ * Reads the delay model for the next loop. Each line of the model holds the
+ * delay of the second input in samples, the fringe phase at the start of the
+ * loop in turns and the fringe rate in turns per sample. Once the model runs
+ * out the last line is used for the remaining loops.
+ */
+void fx_next_model(ga_settings *settings, fx_model *model)
+{
+    fx_model next;
+
+    if (model_fp != NULL && fscanf(model_fp, "%lf %lf %lf", &next.delay,
+        &next.phase, &next.rate) == 3)
+    {
+        model_last = next;
+    }
+
+    *model = model_last;
+}
+
+/*
+ * Executes the cross kernel, accumulating the delay and fringe corrected
+ * cross spectrum of dev_data1 and dev_data2 into dev_cross.
+ */
+void fx_module(ga_settings *settings, cl_vars *cl, cl_mem dev_data1,
+    cl_mem dev_data2, cl_mem dev_cross, double frac_delay, double phase,
+    double rate)
+{
+    cl_int      err_ret;
+    float       f_frac_delay = (float)frac_delay;
+    float       f_phase = (float)(phase - floor(phase));
+    float       f_rate = (float)rate;
+
+    // Rebind the buffers if they have changed
+    if (dev_data1 != cross_data[0])
+    {
+        err_ret = clSetKernelArg(*cross_kernel, 0, sizeof(dev_data1),
+            (void *)&dev_data1);
+        check_error(__FILE__, __LINE__, err_ret);
+        cross_data[0] = dev_data1;
+    }
+
+    if (dev_data2 != cross_data[1])
+    {
+        err_ret = clSetKernelArg(*cross_kernel, 1, sizeof(dev_data2),
+            (void *)&dev_data2);
+        check_error(__FILE__, __LINE__, err_ret);
+        cross_data[1] = dev_data2;
+    }
+
+    if (dev_cross != cross_output)
+    {
+        err_ret = clSetKernelArg(*cross_kernel, 2, sizeof(dev_cross),
+            (void *)&dev_cross);
+        check_error(__FILE__, __LINE__, err_ret);
+        cross_output = dev_cross;
+    }
+
+    // The delay and fringe corrections change every loop
+    err_ret = clSetKernelArg(*cross_kernel, 6, sizeof(f_frac_delay),
+        (void *)&f_frac_delay);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*cross_kernel, 7, sizeof(f_phase),
+        (void *)&f_phase);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*cross_kernel, 8, sizeof(f_rate),
+        (void *)&f_rate);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    // Execute kernel
+    cl_event *event = trace_enqueue_begin("cross");
+    err_ret = clEnqueueNDRangeKernel(cl->queue, *cross_kernel, 1, NULL,
+        cross_global_size, cross_local_size, 0, NULL, event);
+    trace_enqueue_end(event);
+    check_error(__FILE__, __LINE__, err_ret);
+}
@@ -0,0 +1,43 @@
+/*
+ * Accumulates the cross spectrum of two FFT'd inputs. Before the product,
+ * each frame is rotated by theta = 2pi(frac_delay*k/bins + phase + rate*t),
+ * where k is the bin and t is the sample at the centre of the frame, which
+ * removes the residual fractional delay and the fringe phase:
+ *
+ *     cross[k] += F1[k] conj(F2[k]) exp(-i theta)
+ */
+__kernel void cross(__global const float2 *data1,
+    __global const float2 *data2, __global float2 *spectrum,
+    __const int batch_size, __const int spc, __const int bins,
+    __const float frac_delay, __const float phase, __const float rate)
+{
+    int idx = get_global_id(0);
+    int k = idx%(bins/2);
+    int a = (idx/(bins/2))*spc + k;
+
+    float x = 0;
+    float y = 0;
+    for (int s = 0; s < batch_size; s++)
+    {
+        int d = a + s*bins;
+        float2 f1 = data1[d];
+        float2 f2 = data2[d];
+
+        // Product of the first input and the conjugate of the second
+        float re = f1.x*f2.x + f1.y*f2.y;
+        float im = f1.y*f2.x - f1.x*f2.y;
+
+        // Delay and fringe correction for this frame, in turns
+        float turns = frac_delay*k/bins + phase + rate*(s*bins + bins/2);
+        turns -= floor(turns);
+
+        float c;
+        float sn = sincos(-2*M_PI_F*turns, &c);
+
+        x += re*c - im*sn;
+        y += re*sn + im*c;
+    }
+
+    spectrum[idx].x += x;
+    spectrum[idx].y += y;
+}
@@ -0,0 +1,12 @@
+typedef struct
+{
+    double  delay;      // Delay of the second input in samples
+    double  phase;      // Fringe phase at the start of the loop in turns
+    double  rate;       // Fringe rate in turns per sample
+} fx_model;
+
+void fx_initialise(ga_settings *settings, cl_vars *cl);
+void fx_next_model(ga_settings *settings, fx_model *model);
+void fx_module(ga_settings *settings, cl_vars *cl, cl_mem dev_data1,
+    cl_mem dev_data2, cl_mem dev_cross, double frac_delay, double phase,
+    double rate);
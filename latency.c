@@ -0,0 +1,243 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <CL/opencl.h>
+
+#include "main.h"
+#include "latency.h"
+
+// Histogram buckets per octave of latency, and the octaves above one
+// microsecond which are covered
+#define LATENCY_SUB_BUCKETS 4
+#define LATENCY_OCTAVES     28
+#define LATENCY_BUCKETS     (LATENCY_SUB_BUCKETS*LATENCY_OCTAVES)
+
+// Parts of each loop's latency, as histogrammed
+#define LATENCY_TOTAL       0
+#define LATENCY_WAIT        1
+#define LATENCY_TRANSFER    2
+#define LATENCY_KERNELS     3
+#define LATENCY_PARTS       4
+
+// Launches in a row which must finish within half the target before a
+// worker's batch is doubled
+#define LATENCY_GROW_LAUNCHES 4
+
+// Width of the bars of the printed histogram
+#define LATENCY_BAR         40
+
+typedef struct
+{
+    long long   counts[LATENCY_BUCKETS];
+    long long   n;
+    double      max;
+} latency_histogram;
+
+const char          *latency_names[LATENCY_PARTS] =
+    {"Total", "Wait", "Transfer", "Kernels"};
+
+pthread_mutex_t     latency_lock = PTHREAD_MUTEX_INITIALIZER;
+latency_histogram   latency_parts[LATENCY_PARTS];
+double              latency_target;
+long long           latency_met;
+
+// Loops each worker claims per launch, up to its super-batch
+int                 latency_workers;
+int                 *latency_batches;
+int                 *latency_largest;
+int                 *latency_streak;
+
+/*
+ * Sets up the histograms and starts every worker on single loop launches,
+ * which are grown while the latency target allows.
+ */
+void latency_initialise(ga_settings *settings, int n_workers)
+{
+    memset(latency_parts, 0, sizeof(latency_parts));
+    latency_target = settings->latency_target*1e3;
+    latency_met = 0;
+
+    latency_workers = n_workers;
+    latency_batches = malloc(n_workers*sizeof(int));
+    latency_largest = malloc(n_workers*sizeof(int));
+    latency_streak = calloc(n_workers, sizeof(int));
+
+    for (int i = 0; i < n_workers; i++)
+    {
+        latency_batches[i] = 1;
+        latency_largest[i] = 1;
+    }
+}
+
+/*
+ * Returns the number of loops a worker should claim for its next launch,
+ * which is never more than its super-batch.
+ */
+int latency_batch(int worker, int superbatch)
+{
+    pthread_mutex_lock(&latency_lock);
+    int batch = MIN(latency_batches[worker], superbatch);
+    latency_batches[worker] = batch;
+    pthread_mutex_unlock(&latency_lock);
+
+    return batch;
+}
+
+/*
+ * Adds a value in microseconds to a histogram. The buckets are spaced
+ * logarithmically, so the percentiles read from them are within a fraction
+ * of an octave.
+ */
+void latency_add(latency_histogram *h, double us)
+{
+    int b = us > 1 ? (int)(LATENCY_SUB_BUCKETS*log2(us)) : 0;
+
+    h->counts[MIN(b, LATENCY_BUCKETS - 1)]++;
+    h->n++;
+    h->max = MAX(h->max, us);
+}
+
+/*
+ * Records the latency of each loop of a launch, from its arrival until it
+ * was summed into the spectrum at t_done, split into the wait before the
+ * transfer started at t_transfer, the transfer up to t_transferred, and the
+ * kernels. The worker's batch is then halved if the launch missed the
+ * target, or doubled once it has comfortably met it for a few launches,
+ * since the first loop of a launch waits for the rest to arrive and then
+ * for all of them to be processed.
+ */
+void latency_record(int worker, double *arrival, int count, double t_transfer,
+    double t_transferred, double t_done)
+{
+    pthread_mutex_lock(&latency_lock);
+
+    for (int k = 0; k < count; k++)
+    {
+        double total = t_done - arrival[k];
+
+        latency_add(&latency_parts[LATENCY_TOTAL], total);
+        latency_add(&latency_parts[LATENCY_WAIT], t_transfer - arrival[k]);
+        latency_add(&latency_parts[LATENCY_TRANSFER],
+            t_transferred - t_transfer);
+        latency_add(&latency_parts[LATENCY_KERNELS], t_done - t_transferred);
+
+        if (total <= latency_target)
+        {
+            latency_met++;
+        }
+    }
+
+    // The earliest loop of the launch waited longest
+    double worst = t_done - arrival[0];
+
+    if (worst > latency_target)
+    {
+        latency_batches[worker] = MAX(latency_batches[worker]/2, 1);
+        latency_streak[worker] = 0;
+    }
+    else if (worst < latency_target/2 &&
+        ++latency_streak[worker] >= LATENCY_GROW_LAUNCHES)
+    {
+        // Capped by latency_batch at the worker's super-batch
+        latency_batches[worker] *= 2;
+        latency_streak[worker] = 0;
+    }
+
+    latency_largest[worker] = MAX(latency_largest[worker], count);
+
+    pthread_mutex_unlock(&latency_lock);
+}
+
+/*
+ * Returns the latency in microseconds below which the fraction p of the
+ * values in a histogram fall, as the upper edge of the bucket holding it.
+ */
+double latency_percentile(latency_histogram *h, double p)
+{
+    long long rank = (long long)ceil(p*h->n);
+    long long seen = 0;
+
+    for (int b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        seen += h->counts[b];
+
+        if (seen >= rank && seen > 0)
+        {
+            return MIN(pow(2, (double)(b + 1)/LATENCY_SUB_BUCKETS), h->max);
+        }
+    }
+
+    return h->max;
+}
+
+/*
+ * Prints the percentiles of each part of the latency, how often the target
+ * was met, the batches the workers settled on, and a histogram of the total
+ * latency by octave.
+ */
+void latency_report(void)
+{
+    latency_histogram *total = &latency_parts[LATENCY_TOTAL];
+
+    if (total->n == 0)
+    {
+        return;
+    }
+
+    fprintf(stderr, "-- Latency from arrival to the spectrum for %lld loops "
+        "(ms):\n", total->n);
+
+    for (int i = 0; i < LATENCY_PARTS; i++)
+    {
+        latency_histogram *h = &latency_parts[i];
+
+        fprintf(stderr, "--     %s:\tp50 %.3lf\tp99 %.3lf\tmax %.3lf\n",
+            latency_names[i], latency_percentile(h, 0.5)/1e3,
+            latency_percentile(h, 0.99)/1e3, h->max/1e3);
+    }
+
+    fprintf(stderr, "--     Target of %.3lf ms met by %.2lf%% of loops\n",
+        latency_target/1e3, 100.0*latency_met/total->n);
+
+    for (int i = 0; i < latency_workers; i++)
+    {
+        fprintf(stderr, "--     [Worker %d] batch:\t%d loops (largest %d)\n",
+            i, latency_batches[i], latency_largest[i]);
+    }
+
+    // Merge the buckets of each octave, and bar them against the fullest
+    long long   octaves[LATENCY_OCTAVES] = {0};
+    long long   fullest = 0;
+    int         first = LATENCY_OCTAVES;
+    int         last = 0;
+
+    for (int b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        octaves[b/LATENCY_SUB_BUCKETS] += total->counts[b];
+    }
+
+    for (int o = 0; o < LATENCY_OCTAVES; o++)
+    {
+        if (octaves[o] > 0)
+        {
+            first = MIN(first, o);
+            last = o;
+            fullest = MAX(fullest, octaves[o]);
+        }
+    }
+
+    for (int o = first; o <= last; o++)
+    {
+        int bar = (int)(LATENCY_BAR*octaves[o]/fullest);
+
+        fprintf(stderr, "--     < %10.3lf ms: %10lld %.*s\n",
+            pow(2, o + 1)/1e3, octaves[o], bar,
+            "########################################");
+    }
+
+    free(latency_batches);
+    free(latency_largest);
+    free(latency_streak);
+}
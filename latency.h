@@ -0,0 +1,5 @@
+void latency_initialise(ga_settings *settings, int n_workers);
+int latency_batch(int worker, int superbatch);
+void latency_record(int worker, double *arrival, int count, double t_transfer,
+    double t_transferred, double t_done);
+void latency_report(void);
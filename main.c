@@ -1,5 +1,10 @@
+#define _XOPEN_SOURCE 600
+
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <sys/time.h>
 #include <time.h>
 #include <CL/opencl.h>
@@ -13,6 +18,38 @@
 #include "fft.h"
 #include "sum.h"
 #include "spectrum.h"
+#include "partial.h"
+#include "scheduler.h"
+#include "metrics.h"
+#include "waterfall.h"
+#include "fx.h"
+#include "trace.h"
+#include "synth.h"
+#include "zoom.h"
+#include "plan.h"
+#include "numa.h"
+#include "fold.h"
+#include "dedisp.h"
+#include "record.h"
+#include "latency.h"
+
+typedef struct
+{
+    ga_settings *settings;
+    cl_vars     cl;             // OpenCL variables for this worker's device
+    int         worker;         // Index of the worker
+    int         superbatch;     // Loops processed per launch
+    int         numa_node;      // NUMA node the worker runs on (-1 for any)
+    int         loops;          // Number of loops processed
+    double      t_module[STAGES];   // Accumulated time spent in each module
+    cl_float2   *host_output;   // Accumulated spectrum from this device
+    float       *host_folded;   // Folded spectra from this device
+    int         *host_counts;   // Frames folded into each phase bin
+    cl_float2   *host_resolutions;  // Spectra of the additional resolutions
+} worker_vars;
+
+// Released once every worker has initialised its device
+pthread_barrier_t init_barrier;
 
 void timer_start(struct timeval *t_start)
 {
@@ -21,7 +58,7 @@ void timer_start(struct timeval *t_start)
 
 void timer_stop(struct timeval t_start, char *str, double *acc)
 {
-    double time;
+    double time = 0;
     struct timeval t_stop;
 
     gettimeofday(&t_stop, NULL);
@@ -39,162 +76,1160 @@ void timer_stop(struct timeval t_start, char *str, double *acc)
     }
 }
 
-int main(int argc, char *argv[])
+/*
+ * Stops the timer for one module of a worker's loop, accumulating the time for
+ * the timing summary and the metrics.
+ */
+void stage_stop(worker_vars *w, int stage, struct timeval t_start)
 {
-    cl_int      err_ret;
+    double time = 0;
 
-    // Create the first timer
-    struct timeval t_init;
-    timer_start(&t_init);
+    timer_stop(t_start, NULL, &time);
+    w->t_module[stage] += time;
+    metrics_add(METRIC_STAGE_US + stage, (long long)(time*1e6));
+}
 
-    // Process the command-line options
-    ga_settings *settings = malloc(sizeof(ga_settings));
-    memset(settings, 0, sizeof(ga_settings));
-    options(argc, argv, settings);
+/*
+ * Processes loops on a single device until the scheduler runs out of work.
+ * Each worker has its own context, kernels and buffers, and accumulates into
+ * its own spectrum which is copied to the host when the work runs out.
+ */
+void *worker(void *arg)
+{
+    worker_vars *w = (worker_vars *)arg;
+    ga_settings *settings = w->settings;
+    cl_vars     *cl = &w->cl;
+    cl_int      err_ret;
+    char        name[32];
+
+    sprintf(name, "Worker %d", w->worker);
+    trace_thread(name, cl->device_id);
 
-    // Create variables needed for OpenCL
-    cl_vars *cl = malloc(sizeof(cl_vars));
-    cl->device_id = settings->device_id;
+    // Run on the device's node, including any runtime threads started for
+    // the context
+    if (w->numa_node >= 0)
+    {
+        numa_bind_thread(w->numa_node);
+    }
 
     // Create the context and command queue
     cl_initialise(cl);
-    
+
+    int superbatch = w->superbatch;
+
     // Allocate memory on the host
-    unsigned int *host_input = malloc(settings->bytes);
-    cl_float2 *host_output = malloc(settings->output_length*sizeof(cl_float2));
+    size_t input_bytes = settings->history + (size_t)superbatch*settings->bytes;
+    unsigned int *host_input = numa_alloc(input_bytes, w->numa_node);
+    w->host_output = malloc(settings->dump_length*sizeof(cl_float2));
 
-    // Initialise input method
-    input_initialise(settings);
+    if (settings->record_file != NULL)
+    {
+        record_attach(w->worker, host_input, input_bytes, w->numa_node);
+    }
 
     // Initialise kernels
-    convert_initialise(settings, cl);
+    if (settings->zoom > 1)
+    {
+        zoom_initialise(settings, cl);
+    }
+    else
+    {
+        convert_initialise(settings, cl);
+    }
     fft_initialise(settings, cl);
-    sum_initialise(cl);
-    spectrum_initialise(cl);
+    sum_initialise(settings, cl);
+    spectrum_initialise(settings, cl);
 
-    // Create device memory objects
-    cl_mem dev_input = clCreateBuffer(cl->context, CL_MEM_READ_ONLY,
-        settings->bytes, NULL, &err_ret);
+    if (settings->input_type == INPUT_SYNTH)
+    {
+        synth_initialise(settings, cl);
+    }
+
+    if (settings->trigger_file != NULL)
+    {
+        dedisp_initialise(settings, cl, superbatch);
+    }
+
+    if (settings->fold_file != NULL)
+    {
+        fold_initialise(settings, cl, superbatch);
+    }
+
+    // Create device memory objects, the input being written by the device
+    // when it is synthetic
+    cl_mem dev_input = clCreateBuffer(cl->context,
+        settings->input_type == INPUT_SYNTH ? CL_MEM_READ_WRITE :
+        CL_MEM_READ_ONLY, input_bytes, NULL, &err_ret);
     check_error(__FILE__, __LINE__, err_ret);
     cl_mem dev_data = clCreateBuffer(cl->context, CL_MEM_READ_WRITE,
-        settings->n*sizeof(cl_float2), NULL, &err_ret);
+        (size_t)superbatch*settings->data_length*sizeof(cl_float2), NULL,
+        &err_ret);
     check_error(__FILE__, __LINE__, err_ret);
     cl_mem dev_spectrum = clCreateBuffer(cl->context, CL_MEM_WRITE_ONLY,
         settings->output_length*sizeof(cl_float2), NULL, &err_ret);
     check_error(__FILE__, __LINE__, err_ret);
-    cl_mem dev_output = clCreateBuffer(cl->context, CL_MEM_WRITE_ONLY,
+    cl_mem dev_output = clCreateBuffer(cl->context, CL_MEM_READ_WRITE,
         settings->output_length*sizeof(cl_float2), NULL, &err_ret);
     check_error(__FILE__, __LINE__, err_ret);
 
+    // When only some bins are kept, the output is compacted into a smaller
+    // buffer on the device before it is copied back
+    cl_mem dev_dump = dev_output;
+
+    if (settings->select_length > 0)
+    {
+        dev_dump = clCreateBuffer(cl->context, CL_MEM_WRITE_ONLY,
+            settings->dump_length*sizeof(cl_float2), NULL, &err_ret);
+        check_error(__FILE__, __LINE__, err_ret);
+    }
+
     zero_spectrum(settings, cl, dev_spectrum);
     zero_spectrum(settings, cl, dev_output);
+    clFinish(cl->queue);
 
-    // Print the initialisation overhead time
-    fprintf(stderr, "\n");
-    timer_stop(t_init, "-- Initialisation overhead: ", NULL);
+    // The waterfall is double buffered on the host, so the rows of one
+    // launch are written out while those of the next are copied back
+    size_t      wf_length = (size_t)superbatch*settings->waterfall_rows*
+        settings->output_length;
+    cl_mem      dev_waterfall = NULL;
+    float       *host_waterfall[2] = {NULL, NULL};
+    cl_event    wf_event = NULL;
+    long long   wf_loop = 0;
+    int         wf_count = 0;
+    int         wf_buf = 0;
 
-    // Create the timers and accumulators for each module
-    double t_module[5] = {0};
-    struct timeval t_loop;
-    struct timeval t_start;
-    timer_start(&t_loop);
+    if (settings->waterfall_file != NULL || settings->trigger_file != NULL)
+    {
+        dev_waterfall = clCreateBuffer(cl->context, CL_MEM_READ_WRITE,
+            wf_length*sizeof(float), NULL, &err_ret);
+        check_error(__FILE__, __LINE__, err_ret);
+    }
 
-    int loops = 0;
-    for (int p = 0; p < settings->loops || settings->loops == 0; p++)
+    if (settings->waterfall_file != NULL)
     {
-        timer_start(&t_start);
+        host_waterfall[0] = malloc(wf_length*sizeof(float));
+        host_waterfall[1] = malloc(wf_length*sizeof(float));
+    }
 
-        // Read in the data
-        int r_bytes = read_data(settings, host_input, settings->bytes);
+    // The folded spectra stay on the device until the work runs out, and
+    // start from zero
+    size_t      fold_length = (size_t)settings->phase_bins*
+        settings->output_length;
+    cl_mem      dev_folded = NULL;
+    cl_mem      dev_counts = NULL;
 
-        if (r_bytes != settings->bytes)
+    if (settings->fold_file != NULL)
+    {
+        w->host_folded = calloc(fold_length, sizeof(float));
+        w->host_counts = calloc(settings->phase_bins, sizeof(int));
+        dev_folded = clCreateBuffer(cl->context,
+            CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+            fold_length*sizeof(float), w->host_folded, &err_ret);
+        check_error(__FILE__, __LINE__, err_ret);
+        dev_counts = clCreateBuffer(cl->context,
+            CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+            settings->phase_bins*sizeof(int), w->host_counts, &err_ret);
+        check_error(__FILE__, __LINE__, err_ret);
+    }
+
+    // Each additional resolution is transformed in turn into one scratch
+    // buffer, and summed into a spectrum of its own
+    cl_mem      dev_resolution_data = NULL;
+    cl_mem      *dev_resolutions = NULL;
+
+    if (settings->n_resolutions > 0)
+    {
+        w->host_resolutions = calloc(settings->resolutions_length,
+            sizeof(cl_float2));
+        dev_resolution_data = clCreateBuffer(cl->context, CL_MEM_READ_WRITE,
+            (size_t)superbatch*settings->data_length*sizeof(cl_float2), NULL,
+            &err_ret);
+        check_error(__FILE__, __LINE__, err_ret);
+        dev_resolutions = malloc(settings->n_resolutions*sizeof(cl_mem));
+
+        for (int r = 0; r < settings->n_resolutions; r++)
         {
-            // Number of bytes read does not match number of bytes required
-            fprintf(stderr, "Unable to read %d bytes (only read %d bytes)\n",
-                settings->bytes, r_bytes);
+            dev_resolutions[r] = clCreateBuffer(cl->context,
+                CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                settings->resolution_lengths[r]*sizeof(cl_float2),
+                w->host_resolutions, &err_ret);
+            check_error(__FILE__, __LINE__, err_ret);
+        }
+    }
+
+    // Wait for the other workers before starting the timed loop
+    pthread_barrier_wait(&init_barrier);
+
+    struct timeval  t_item;
+    struct timeval  t_start;
+    long long       loop;
+    int             count;
+    int             batch = superbatch;
+    double          *arrival = NULL;
+    double          t_transfer = 0;
+    double          t_transferred = 0;
+
+    // In the latency mode each loop is stamped as it arrives
+    if (settings->latency_target > 0)
+    {
+        arrival = malloc(superbatch*sizeof(double));
+    }
 
-            // Indicates EOF (with some data unused), break out of main loop
+    for (;;)
+    {
+        timer_start(&t_item);
+        timer_start(&t_start);
+
+        if (arrival != NULL)
+        {
+            batch = latency_batch(w->worker, superbatch);
+        }
+
+        // Claim the next loops and read in their data
+        count = scheduler_claim(settings, w->worker, host_input, batch,
+            &loop, arrival);
+
+        if (count == 0)
+        {
             break;
         }
 
-        timer_stop(t_start, NULL, &t_module[0]);
+        stage_stop(w, 0, t_start);
+        metrics_add(METRIC_BUSY_WORKERS, 1);
         timer_start(&t_start);
+        t_transfer = trace_now();
 
-        // Transfer input data to device
-        err_ret = clEnqueueWriteBuffer(cl->queue, dev_input, CL_TRUE, 0,
-            settings->bytes, host_input, 0, NULL, NULL);
-        check_error(__FILE__, __LINE__, err_ret);
+        if (settings->input_type == INPUT_SYNTH)
+        {
+            // Generate the input on the device in place of the transfer
+            synth_module(settings, cl, dev_input, loop, count);
+        }
+        else
+        {
+            // Transfer input data to device
+            cl_event *event = trace_enqueue_begin("h2d");
+            err_ret = clEnqueueWriteBuffer(cl->queue, dev_input, CL_TRUE, 0,
+                settings->history + (size_t)count*settings->bytes,
+                host_input, 0, NULL, event);
+            trace_enqueue_end(event);
+            check_error(__FILE__, __LINE__, err_ret);
+
+            // The transfer has finished, so the same buffer can be written to
+            // disk while the next loops are read into another
+            if (settings->record_file != NULL)
+            {
+                host_input = record_swap(w->worker, host_input, loop, count);
+            }
+        }
 
         clFinish(cl->queue);
-        timer_stop(t_start, NULL, &t_module[1]);
+        stage_stop(w, 1, t_start);
         timer_start(&t_start);
+        t_transferred = trace_now();
 
-        // Execute convert module
-        convert_module(settings, cl, dev_input, dev_data);
+        // Execute convert module, or the zoom module which replaces it
+        if (settings->zoom > 1)
+        {
+            zoom_module(settings, cl, dev_input, dev_data, count);
+        }
+        else
+        {
+            convert_module(settings, cl, dev_input, dev_data, count);
+        }
 
         clFinish(cl->queue);
-        timer_stop(t_start, NULL, &t_module[2]);
+        stage_stop(w, 2, t_start);
         timer_start(&t_start);
 
+        // Transform and sum the additional resolutions while the converted
+        // data is intact, timing them with the FFT as they share its buffer
+        for (int r = 0; r < settings->n_resolutions; r++)
+        {
+            fft_resolution_module(settings, cl, r, dev_data,
+                dev_resolution_data, count);
+            sum_resolution_module(settings, cl, r, dev_resolution_data,
+                dev_resolutions[r], count);
+        }
+
         // Execute FFT module
-        fft_module(settings, cl, dev_data);
+        fft_module(settings, cl, dev_data, count);
 
         clFinish(cl->queue);
-        timer_stop(t_start, NULL, &t_module[3]);
+        stage_stop(w, 3, t_start);
         timer_start(&t_start);
 
-        // Execute the sum module
-        sum_module(settings, cl, dev_data, dev_spectrum);
+        // Execute the sum module, which also writes the rows of the waterfall
+        sum_module(settings, cl, dev_data, dev_spectrum, dev_waterfall, count);
 
         clFinish(cl->queue);
-        timer_stop(t_start, NULL, &t_module[4]);
+        stage_stop(w, 4, t_start);
+
+        // The loops are now in the accumulated spectrum
+        if (arrival != NULL)
+        {
+            latency_record(w->worker, arrival, count, t_transfer,
+                t_transferred, trace_now());
+        }
+
+        if (settings->waterfall_file != NULL)
+        {
+            timer_start(&t_start);
+
+            // Start copying the rows back
+            cl_event wf_read;
+            err_ret = clEnqueueReadBuffer(cl->queue, dev_waterfall, CL_FALSE,
+                0, (size_t)count*settings->waterfall_rows*
+                settings->output_length*sizeof(float), host_waterfall[wf_buf],
+                0, NULL, &wf_read);
+            check_error(__FILE__, __LINE__, err_ret);
+
+            // Write out the rows of the previous launch in the meantime
+            if (wf_event != NULL)
+            {
+                clWaitForEvents(1, &wf_event);
+                clReleaseEvent(wf_event);
+                waterfall_write(settings, host_waterfall[1 - wf_buf], wf_loop,
+                    wf_count);
+            }
+
+            wf_event = wf_read;
+            wf_loop = loop;
+            wf_count = count;
+            wf_buf = 1 - wf_buf;
+
+            stage_stop(w, 5, t_start);
+        }
+
+        if (settings->trigger_file != NULL)
+        {
+            timer_start(&t_start);
+
+            // Dedisperse and search the rows, which the queue copies before
+            // the next launch overwrites them
+            dedisp_module(settings, cl, dev_waterfall, loop, count);
+
+            clFinish(cl->queue);
+            stage_stop(w, 7, t_start);
+        }
+
+        if (settings->fold_file != NULL)
+        {
+            timer_start(&t_start);
+
+            // Execute the fold module
+            fold_module(settings, cl, dev_data, dev_folded, dev_counts, loop,
+                count);
+
+            clFinish(cl->queue);
+            stage_stop(w, 6, t_start);
+        }
+
+        // Report the time per loop for load balancing
+        double t_loop = 0;
+        timer_stop(t_item, NULL, &t_loop);
+        scheduler_complete(w->worker, t_loop/count);
 
-        loops++;
+        w->loops += count;
+        metrics_add(METRIC_LOOPS, count);
+        metrics_add(METRIC_SAMPLES, (long long)count*settings->n);
+        metrics_add(METRIC_BUSY_WORKERS, -1);
+
+        // Record the device time of the commands which have completed
+        trace_collect();
     }
 
-    // Print the loop timing information
-    fprintf(stderr, "-- Timing information for %d loops:\n", loops);
-    fprintf(stderr, "--     Read:\t%.6lf\n", t_module[0]);
-    fprintf(stderr, "--     H->D:\t%.6lf\n", t_module[1]);
-    fprintf(stderr, "--     Convert:\t%.6lf\n", t_module[2]);
-    fprintf(stderr, "--     FFT:\t%.6lf\n", t_module[3]);
-    fprintf(stderr, "--     Sum:\t%.6lf\n", t_module[4]);
-    timer_stop(t_loop, "-- Total loop time: ", NULL);
+    // Write out the rows of the final launch
+    if (wf_event != NULL)
+    {
+        clWaitForEvents(1, &wf_event);
+        clReleaseEvent(wf_event);
+        waterfall_write(settings, host_waterfall[1 - wf_buf], wf_loop,
+            wf_count);
+    }
+
+    struct timeval t_dump;
+    timer_start(&t_dump);
 
     // TODO: This will be moved into an if statement in the loop
     add_spectrum(settings, cl, dev_spectrum, dev_output);
     zero_spectrum(settings, cl, dev_spectrum);
 
+    if (dev_dump != dev_output)
+    {
+        select_spectrum(settings, cl, dev_output, dev_dump);
+    }
+
     // Copy result back to host
-    err_ret = clEnqueueReadBuffer(cl->queue, dev_output, CL_TRUE, 0,
-        settings->output_length*sizeof(cl_float2), host_output, 0, NULL, NULL);
+    cl_event *event = trace_enqueue_begin("d2h");
+    err_ret = clEnqueueReadBuffer(cl->queue, dev_dump, CL_TRUE, 0,
+        settings->dump_length*sizeof(cl_float2), w->host_output, 0, NULL,
+        event);
+    trace_enqueue_end(event);
     check_error(__FILE__, __LINE__, err_ret);
 
-    // Block until the output has been transferred to the host
-    clFinish(cl->queue);
-
-    // Print the result
-    for (int i = 0; i < settings->output_length; i++)
+    for (int r = 0, offset = 0; r < settings->n_resolutions; r++)
     {
-        if (i % (settings->bins/2) == 0)
-        {
-            printf("\n");
-        }
+        err_ret = clEnqueueReadBuffer(cl->queue, dev_resolutions[r], CL_TRUE,
+            0, settings->resolution_lengths[r]*sizeof(cl_float2),
+            w->host_resolutions + offset, 0, NULL, NULL);
+        check_error(__FILE__, __LINE__, err_ret);
+        offset += settings->resolution_lengths[r];
+    }
 
-        float *elem = (float *)(&host_output[i]);
-        printf("%f\n", *elem);
+    if (dev_folded != NULL)
+    {
+        err_ret = clEnqueueReadBuffer(cl->queue, dev_folded, CL_TRUE, 0,
+            fold_length*sizeof(float), w->host_folded, 0, NULL, NULL);
+        check_error(__FILE__, __LINE__, err_ret);
+        err_ret = clEnqueueReadBuffer(cl->queue, dev_counts, CL_TRUE, 0,
+            settings->phase_bins*sizeof(int), w->host_counts, 0, NULL, NULL);
+        check_error(__FILE__, __LINE__, err_ret);
     }
 
+    // Block until the output has been transferred to the host
+    clFinish(cl->queue);
+    trace_collect();
+
+    double t_dumped = 0;
+    timer_stop(t_dump, NULL, &t_dumped);
+    metrics_add(METRIC_DUMPS, 1);
+    metrics_add(METRIC_DUMP_US, (long long)(t_dumped*1e6));
+
     // Release buffers
     err_ret = clReleaseMemObject(dev_input);
     check_error(__FILE__, __LINE__, err_ret);
     err_ret = clReleaseMemObject(dev_data);
     check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clReleaseMemObject(dev_spectrum);
+    check_error(__FILE__, __LINE__, err_ret);
     err_ret = clReleaseMemObject(dev_output);
     check_error(__FILE__, __LINE__, err_ret);
 
+    if (dev_dump != dev_output)
+    {
+        err_ret = clReleaseMemObject(dev_dump);
+        check_error(__FILE__, __LINE__, err_ret);
+    }
+
+    if (dev_waterfall != NULL)
+    {
+        err_ret = clReleaseMemObject(dev_waterfall);
+        check_error(__FILE__, __LINE__, err_ret);
+    }
+
+    if (dev_folded != NULL)
+    {
+        err_ret = clReleaseMemObject(dev_folded);
+        check_error(__FILE__, __LINE__, err_ret);
+        err_ret = clReleaseMemObject(dev_counts);
+        check_error(__FILE__, __LINE__, err_ret);
+    }
+
+    if (dev_resolution_data != NULL)
+    {
+        err_ret = clReleaseMemObject(dev_resolution_data);
+        check_error(__FILE__, __LINE__, err_ret);
+
+        for (int r = 0; r < settings->n_resolutions; r++)
+        {
+            err_ret = clReleaseMemObject(dev_resolutions[r]);
+            check_error(__FILE__, __LINE__, err_ret);
+        }
+        free(dev_resolutions);
+    }
+
+    // Free allocated memory on host, once any recording of it is written
+    if (settings->record_file != NULL)
+    {
+        record_detach(w->worker);
+    }
+    else
+    {
+        free(host_input);
+    }
+    free(host_waterfall[0]);
+    free(host_waterfall[1]);
+    free(arrival);
+
+    return NULL;
+}
+
+/*
+ * Cross-correlates two inputs on a single device. Both inputs are converted
+ * and FFT'd with the existing modules. Each input buffer on the device holds
+ * the previous loop followed by the current one, so that integer sample
+ * delays are applied by starting the convert kernel earlier in the buffer.
+ * The fractional delay and fringe rotation are applied by the cross kernel.
+ * The output holds the autocorrelation of each input and the cross spectrum.
+ */
+void *fx_worker(void *arg)
+{
+    worker_vars *w = (worker_vars *)arg;
+    ga_settings *settings = w->settings;
+    cl_vars     *cl = &w->cl;
+    cl_int      err_ret;
+    char        name[32];
+
+    sprintf(name, "Worker %d", w->worker);
+    trace_thread(name, cl->device_id);
+
+    // Run on the device's node, including any runtime threads started for
+    // the context
+    if (w->numa_node >= 0)
+    {
+        numa_bind_thread(w->numa_node);
+    }
+
+    // Create the context and command queue
+    cl_initialise(cl);
+
+    // Allocate memory on the host
+    unsigned int *host_input[2];
+    host_input[0] = numa_alloc(settings->bytes, w->numa_node);
+    host_input[1] = numa_alloc(settings->bytes, w->numa_node);
+    w->host_output = malloc(3*settings->dump_length*sizeof(cl_float2));
+
+    // Initialise kernels
+    convert_initialise(settings, cl);
+    fft_initialise(settings, cl);
+    sum_initialise(settings, cl);
+    spectrum_initialise(settings, cl);
+    fx_initialise(settings, cl);
+
+    // Create device memory objects, starting with zeroed history
+    cl_mem dev_input[2];
+    cl_mem dev_data[2];
+    cl_mem dev_spectrum[3];
+    cl_mem dev_output[3];
+    unsigned char *zeros = calloc(2*settings->bytes, 1);
+
+    for (int i = 0; i < 2; i++)
+    {
+        dev_input[i] = clCreateBuffer(cl->context,
+            CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, 2*settings->bytes,
+            zeros, &err_ret);
+        check_error(__FILE__, __LINE__, err_ret);
+        dev_data[i] = clCreateBuffer(cl->context, CL_MEM_READ_WRITE,
+            settings->data_length*sizeof(cl_float2), NULL, &err_ret);
+        check_error(__FILE__, __LINE__, err_ret);
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        dev_spectrum[i] = clCreateBuffer(cl->context, CL_MEM_READ_WRITE,
+            settings->output_length*sizeof(cl_float2), NULL, &err_ret);
+        check_error(__FILE__, __LINE__, err_ret);
+        dev_output[i] = clCreateBuffer(cl->context, CL_MEM_READ_WRITE,
+            settings->output_length*sizeof(cl_float2), NULL, &err_ret);
+        check_error(__FILE__, __LINE__, err_ret);
+
+        zero_spectrum(settings, cl, dev_spectrum[i]);
+        zero_spectrum(settings, cl, dev_output[i]);
+    }
+
+    // Each spectrum is compacted in turn when only some bins are kept
+    cl_mem dev_dump = NULL;
+
+    if (settings->select_length > 0)
+    {
+        dev_dump = clCreateBuffer(cl->context, CL_MEM_WRITE_ONLY,
+            settings->dump_length*sizeof(cl_float2), NULL, &err_ret);
+        check_error(__FILE__, __LINE__, err_ret);
+    }
+
+    clFinish(cl->queue);
+    free(zeros);
+
+    // Wait for the other workers before starting the timed loop
+    pthread_barrier_wait(&init_barrier);
+
+    struct timeval  t_start;
+    long long       loop;
+    fx_model        model;
+
+    for (;;)
+    {
+        timer_start(&t_start);
+
+        // Claim the next loop and read in the data from both inputs
+        if (scheduler_claim(settings, w->worker, host_input[0], 1,
+            &loop, NULL) == 0)
+        {
+            break;
+        }
+
+        int r_bytes = read_data_input2(settings, host_input[1],
+            settings->bytes);
+        metrics_add(METRIC_BYTES_READ, r_bytes);
+
+        if (r_bytes != settings->bytes)
+        {
+            fprintf(stderr, "Unable to read %d bytes from the second input "
+                "(only read %d bytes)\n", settings->bytes, r_bytes);
+            break;
+        }
+
+        fx_next_model(settings, &model);
+
+        stage_stop(w, 0, t_start);
+        metrics_add(METRIC_BUSY_WORKERS, 1);
+        timer_start(&t_start);
+
+        // Move the previous loop into the history and transfer the new loop
+        for (int i = 0; i < 2; i++)
+        {
+            cl_event *event = trace_enqueue_begin("history");
+            err_ret = clEnqueueCopyBuffer(cl->queue, dev_input[i],
+                dev_input[i], settings->bytes, 0, settings->bytes, 0, NULL,
+                event);
+            trace_enqueue_end(event);
+            check_error(__FILE__, __LINE__, err_ret);
+            event = trace_enqueue_begin("h2d");
+            err_ret = clEnqueueWriteBuffer(cl->queue, dev_input[i], CL_TRUE,
+                settings->bytes, settings->bytes, host_input[i], 0, NULL,
+                event);
+            trace_enqueue_end(event);
+            check_error(__FILE__, __LINE__, err_ret);
+        }
+
+        clFinish(cl->queue);
+        stage_stop(w, 1, t_start);
+        timer_start(&t_start);
+
+        // Split the delay into whole samples, applied by delaying whichever
+        // input leads, and a fractional part in [0, 1)
+        double whole = floor(model.delay);
+        int delay = (int)whole;
+
+        if (delay > settings->spc || -delay > settings->spc)
+        {
+            fprintf(stderr, "Delay of %.1lf samples exceeds one loop\n",
+                model.delay);
+            exit(EXIT_FAILURE);
+        }
+
+        // Execute convert module on each input
+        convert_set_offset(settings->spc - (delay > 0 ? delay : 0));
+        convert_module(settings, cl, dev_input[0], dev_data[0], 1);
+        convert_set_offset(settings->spc - (delay < 0 ? -delay : 0));
+        convert_module(settings, cl, dev_input[1], dev_data[1], 1);
+
+        clFinish(cl->queue);
+        stage_stop(w, 2, t_start);
+        timer_start(&t_start);
+
+        // Execute FFT module on each input
+        fft_module(settings, cl, dev_data[0], 1);
+        fft_module(settings, cl, dev_data[1], 1);
+
+        clFinish(cl->queue);
+        stage_stop(w, 3, t_start);
+        timer_start(&t_start);
+
+        // Accumulate the autocorrelations and the cross spectrum
+        sum_module(settings, cl, dev_data[0], dev_spectrum[0], NULL, 1);
+        sum_module(settings, cl, dev_data[1], dev_spectrum[1], NULL, 1);
+        fx_module(settings, cl, dev_data[0], dev_data[1], dev_spectrum[2],
+            model.delay - whole, model.phase, model.rate);
+
+        clFinish(cl->queue);
+        stage_stop(w, 4, t_start);
+
+        w->loops++;
+        metrics_add(METRIC_LOOPS, 1);
+        metrics_add(METRIC_SAMPLES, 2LL*settings->n);
+        metrics_add(METRIC_BUSY_WORKERS, -1);
+
+        // Record the device time of the commands which have completed
+        trace_collect();
+    }
+
+    // Copy the three spectra back to the host
+    for (int i = 0; i < 3; i++)
+    {
+        add_spectrum(settings, cl, dev_spectrum[i], dev_output[i]);
+
+        cl_mem dev_read = dev_output[i];
+        if (dev_dump != NULL)
+        {
+            select_spectrum(settings, cl, dev_output[i], dev_dump);
+            dev_read = dev_dump;
+        }
+
+        cl_event *event = trace_enqueue_begin("d2h");
+        err_ret = clEnqueueReadBuffer(cl->queue, dev_read, CL_TRUE, 0,
+            settings->dump_length*sizeof(cl_float2),
+            w->host_output + i*settings->dump_length, 0, NULL, event);
+        trace_enqueue_end(event);
+        check_error(__FILE__, __LINE__, err_ret);
+    }
+
+    clFinish(cl->queue);
+    trace_collect();
+    metrics_add(METRIC_DUMPS, 1);
+
+    // Release buffers
+    for (int i = 0; i < 2; i++)
+    {
+        err_ret = clReleaseMemObject(dev_input[i]);
+        check_error(__FILE__, __LINE__, err_ret);
+        err_ret = clReleaseMemObject(dev_data[i]);
+        check_error(__FILE__, __LINE__, err_ret);
+        free(host_input[i]);
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        err_ret = clReleaseMemObject(dev_spectrum[i]);
+        check_error(__FILE__, __LINE__, err_ret);
+        err_ret = clReleaseMemObject(dev_output[i]);
+        check_error(__FILE__, __LINE__, err_ret);
+    }
+
+    if (dev_dump != NULL)
+    {
+        err_ret = clReleaseMemObject(dev_dump);
+        check_error(__FILE__, __LINE__, err_ret);
+    }
+
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    // Create the first timer
+    struct timeval t_init;
+    timer_start(&t_init);
+
+    // Process the command-line options
+    ga_settings *settings = malloc(sizeof(ga_settings));
+    memset(settings, 0, sizeof(ga_settings));
+    options(argc, argv, settings);
+
+    // Find the available devices
+    cl_device_list devices;
+    cl_find_devices(settings, &devices);
+
+    // If the device was unspecified exit after listing available devices
+    if (settings->n_device_ids == 0)
+    {
+        exit(EXIT_SUCCESS);
+    }
+
+    // Check the NUMA placement before creating any workers
+    int n_selected = settings->n_device_ids == -1 ? devices.n_devices :
+        settings->n_device_ids;
+    int n_nodes = numa_node_count();
+
+    if (settings->n_numa_nodes > 1 && settings->n_numa_nodes != n_selected)
+    {
+        fprintf(stderr, "Give one NUMA node, or one per selected device\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < settings->n_numa_nodes; i++)
+    {
+        if (settings->numa_nodes[i] < 0 || settings->numa_nodes[i] >= n_nodes)
+        {
+            fprintf(stderr, "Invalid NUMA node: %d\n",
+                settings->numa_nodes[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (settings->reader_node >= n_nodes)
+    {
+        fprintf(stderr, "Invalid NUMA node: %d\n", settings->reader_node);
+        exit(EXIT_FAILURE);
+    }
+
+    // Create a worker for each selected device, or for each NUMA node of a
+    // CPU device when they are split
+    int n_workers = 0;
+    worker_vars *workers = NULL;
+
+    for (int i = 0; i < n_selected; i++)
+    {
+        int id = settings->n_device_ids == -1 ? i : settings->device_ids[i];
+
+        if (id < 0 || id >= devices.n_devices)
+        {
+            fprintf(stderr, "Invalid device id: %d\n", id);
+            exit(EXIT_FAILURE);
+        }
+
+        cl_device_id *sub_devices = NULL;
+        int n_sub = 0;
+
+        if (settings->split_numa)
+        {
+            n_sub = cl_split_numa(devices.devices[id], &sub_devices);
+        }
+
+        for (int s = 0; s < MAX(n_sub, 1); s++)
+        {
+            workers = realloc(workers, (n_workers + 1)*sizeof(worker_vars));
+            worker_vars *w = &workers[n_workers];
+            memset(w, 0, sizeof(worker_vars));
+
+            w->settings = settings;
+            w->worker = n_workers;
+            w->cl.device_id = id;
+            w->cl.platform = devices.platforms[id];
+            w->cl.device = n_sub > 0 ? sub_devices[s] : devices.devices[id];
+            w->cl.profiling = settings->trace_file != NULL;
+
+            // Sub-devices are created in the order of the nodes they cover
+            if (n_sub > 0)
+            {
+                w->numa_node = s < n_nodes ? s : -1;
+            }
+            else if (settings->n_numa_nodes > 0)
+            {
+                w->numa_node = settings->numa_nodes[
+                    settings->n_numa_nodes == 1 ? 0 : i];
+            }
+            else
+            {
+                w->numa_node = -1;
+            }
+
+            n_workers++;
+        }
+
+        free(sub_devices);
+    }
+
+    // Report the topology the workers will run on
+    if (n_nodes > 1 || settings->n_numa_nodes > 0 || settings->split_numa)
+    {
+        fprintf(stderr, "NUMA nodes: %d\n", n_nodes);
+
+        for (int i = 0; i < n_nodes; i++)
+        {
+            char *cpus = numa_cpulist(i);
+            fprintf(stderr, "    [Node %d] CPUs %s\n", i, cpus);
+            free(cpus);
+        }
+
+        for (int i = 0; i < n_workers; i++)
+        {
+            if (workers[i].numa_node >= 0)
+            {
+                fprintf(stderr, "    [Worker %d] Device %d on node %d\n", i,
+                    workers[i].cl.device_id, workers[i].numa_node);
+            }
+            else
+            {
+                fprintf(stderr, "    [Worker %d] Device %d unpinned\n", i,
+                    workers[i].cl.device_id);
+            }
+        }
+
+        if (settings->reader_node >= 0)
+        {
+            fprintf(stderr, "    Reader threads on node %d\n",
+                settings->reader_node);
+        }
+    }
+
+    // Cross-correlation relies on each loop following the previous one
+    if (settings->input2_file != NULL && n_workers > 1)
+    {
+        fprintf(stderr, "Cross-correlation requires a single device\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // As does dedispersion, which runs on from the rows of earlier loops
+    if (settings->trigger_file != NULL && n_workers > 1)
+    {
+        fprintf(stderr, "Dedispersion requires a single device\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Plan the batch size within the memory of the smallest device
+    if (settings->integration > 0)
+    {
+        cl_ulong global_mem = 0;
+        cl_ulong max_alloc = 0;
+
+        for (int i = 0; i < n_workers; i++)
+        {
+            cl_ulong g, a;
+            plan_device_memory(&workers[i].cl, &g, &a);
+
+            if (i == 0 || g < global_mem)
+            {
+                global_mem = g;
+            }
+            if (i == 0 || a < max_alloc)
+            {
+                max_alloc = a;
+            }
+        }
+
+        plan_batch(settings, global_mem, max_alloc, n_workers);
+        options_derive(settings);
+    }
+
+    // Choose how many loops each device processes per launch, and check that
+    // its buffers fit before any are created
+    for (int i = 0; i < n_workers; i++)
+    {
+        workers[i].superbatch = scheduler_superbatch(settings, &workers[i].cl);
+        plan_footprint(settings, &workers[i].cl, workers[i].superbatch);
+    }
+
+    // Pin the main thread to the reader's node while the input starts, so
+    // that any reader threads it starts are placed there too, but not the
+    // workers started after it
+    if (settings->reader_node >= 0)
+    {
+        numa_bind_thread(settings->reader_node);
+    }
+
+    // Initialise input method and the shared work queue
+    trace_initialise(settings);
+    trace_thread("Main", -1);
+    input_initialise(settings);
+
+    if (settings->reader_node >= 0)
+    {
+        numa_unbind_thread();
+    }
+
+    scheduler_initialise(settings, n_workers);
+    metrics_initialise(settings);
+
+    if (settings->waterfall_file != NULL)
+    {
+        waterfall_open(settings);
+    }
+
+    if (settings->trigger_file != NULL)
+    {
+        dedisp_open(settings);
+    }
+
+    if (settings->record_file != NULL)
+    {
+        record_open(settings, n_workers);
+    }
+
+    if (settings->latency_target > 0)
+    {
+        latency_initialise(settings, n_workers);
+    }
+
+    // Start the workers, which initialise their devices concurrently
+    pthread_t *threads = malloc(n_workers*sizeof(pthread_t));
+    pthread_barrier_init(&init_barrier, NULL, n_workers + 1);
+
+    for (int i = 0; i < n_workers; i++)
+    {
+        pthread_create(&threads[i], NULL,
+            settings->input2_file != NULL ? fx_worker : worker, &workers[i]);
+    }
+
+    pthread_barrier_wait(&init_barrier);
+
+    // Print the initialisation overhead time
+    fprintf(stderr, "\n");
+    timer_stop(t_init, "-- Initialisation overhead: ", NULL);
+
+    struct timeval t_loop;
+    timer_start(&t_loop);
+
+    // Wait for the workers, then combine their timings and spectra
+    double t_module[STAGES] = {0};
+    int loops = 0;
+    int output_length = settings->spectra*settings->dump_length;
+    cl_float2 *host_output = calloc(output_length, sizeof(cl_float2));
+
+    for (int i = 0; i < n_workers; i++)
+    {
+        pthread_join(threads[i], NULL);
+
+        for (int m = 0; m < STAGES; m++)
+        {
+            t_module[m] += workers[i].t_module[m];
+        }
+
+        for (int j = 0; j < output_length; j++)
+        {
+            host_output[j].s[0] += workers[i].host_output[j].s[0];
+            host_output[j].s[1] += workers[i].host_output[j].s[1];
+        }
+
+        loops += workers[i].loops;
+    }
+
+    input_terminate(settings);
+    metrics_terminate();
+    waterfall_close();
+    dedisp_close();
+    record_close();
+
+    // Combine the folded spectra of every device
+    if (settings->fold_file != NULL)
+    {
+        size_t fold_length = (size_t)settings->phase_bins*
+            settings->output_length;
+
+        for (int i = 1; i < n_workers; i++)
+        {
+            for (size_t j = 0; j < fold_length; j++)
+            {
+                workers[0].host_folded[j] += workers[i].host_folded[j];
+            }
+
+            for (int p = 0; p < settings->phase_bins; p++)
+            {
+                workers[0].host_counts[p] += workers[i].host_counts[p];
+            }
+        }
+
+        fold_write(settings, workers[0].host_folded, workers[0].host_counts);
+    }
+
+    // Combine the spectra of the additional resolutions
+    for (int i = 1; i < n_workers; i++)
+    {
+        for (int j = 0; j < settings->resolutions_length; j++)
+        {
+            workers[0].host_resolutions[j].s[0] +=
+                workers[i].host_resolutions[j].s[0];
+            workers[0].host_resolutions[j].s[1] +=
+                workers[i].host_resolutions[j].s[1];
+        }
+    }
+
+    // Print the loop timing information
+    fprintf(stderr, "-- Timing information for %d loops:\n", loops);
+    fprintf(stderr, "--     Read:\t%.6lf\n", t_module[0]);
+    if (settings->input_type == INPUT_SYNTH)
+    {
+        fprintf(stderr, "--     Synth:\t%.6lf\n", t_module[1]);
+    }
+    else
+    {
+        fprintf(stderr, "--     H->D:\t%.6lf\n", t_module[1]);
+    }
+    if (settings->zoom > 1)
+    {
+        fprintf(stderr, "--     Zoom:\t%.6lf\n", t_module[2]);
+    }
+    else
+    {
+        fprintf(stderr, "--     Convert:\t%.6lf\n", t_module[2]);
+    }
+    fprintf(stderr, "--     FFT:\t%.6lf\n", t_module[3]);
+    fprintf(stderr, "--     Sum:\t%.6lf\n", t_module[4]);
+
+    if (settings->waterfall_file != NULL)
+    {
+        fprintf(stderr, "--     Waterfall:\t%.6lf\n", t_module[5]);
+    }
+
+    if (settings->fold_file != NULL)
+    {
+        fprintf(stderr, "--     Fold:\t%.6lf\n", t_module[6]);
+    }
+
+    if (settings->trigger_file != NULL)
+    {
+        fprintf(stderr, "--     Dedisperse:\t%.6lf\n", t_module[7]);
+    }
+
+    if (n_workers > 1)
+    {
+        for (int i = 0; i < n_workers; i++)
+        {
+            fprintf(stderr, "--     [Device %d] loops:\t%d\n",
+                workers[i].cl.device_id, workers[i].loops);
+        }
+    }
+
+    double t_total = 0;
+    timer_stop(t_loop, "-- Total loop time: ", &t_total);
+    fprintf(stderr, "-- Loops per second: %.2lf\n", loops/t_total);
+
+    if (settings->latency_target > 0)
+    {
+        latency_report();
+    }
+
+    double t_output = trace_now();
+
+    if (settings->partial_file != NULL)
+    {
+        // Write the partial spectrum so it can be merged with other ranges
+        partial_header header;
+        header.bins = settings->bins;
+        header.channels = settings->channels;
+        header.spc = settings->spc;
+        header.bytes = settings->bytes;
+        header.output_length = settings->dump_length;
+        header.loops = loops;
+        header.offset = settings->offset;
+        partial_write(settings->partial_file, &header, (float *)host_output);
+    }
+    else
+    {
+        // Print the result, with the real and imaginary parts of the cross
+        // spectrum following the autocorrelations
+        for (int i = 0; i < output_length; i++)
+        {
+            if (i % (settings->dump_length/settings->channels) == 0)
+            {
+                printf("\n");
+            }
+
+            float *elem = (float *)(&host_output[i]);
+
+            if (i < 2*settings->dump_length)
+            {
+                printf("%f\n", elem[0]);
+            }
+            else
+            {
+                printf("%f %f\n", elem[0], elem[1]);
+            }
+        }
+
+        // Print each additional resolution in turn in the same way
+        for (int r = 0, offset = 0; r < settings->n_resolutions; r++)
+        {
+            int row_length = (settings->resolution_lengths[r])/
+                (settings->channels);
+
+            for (int i = 0; i < settings->resolution_lengths[r]; i++)
+            {
+                if (i % row_length == 0)
+                {
+                    printf("\n");
+                }
+
+                printf("%f\n", workers[0].host_resolutions[offset + i].s[0]);
+            }
+
+            offset += settings->resolution_lengths[r];
+        }
+    }
+
+    trace_span("output", t_output);
+    trace_write(settings);
+
     // Free allocated memory on host
-    free(host_input);
+    for (int i = 0; i < n_workers; i++)
+    {
+        free(workers[i].host_output);
+        free(workers[i].host_folded);
+        free(workers[i].host_counts);
+        free(workers[i].host_resolutions);
+    }
+    free(workers);
+    free(threads);
     free(host_output);
 
     // Print the total execution time
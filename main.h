@@ -2,17 +2,39 @@
 #define INPUT_STDIN     1
 #define INPUT_FILE      2
 #define INPUT_NETWORK   3
+#define INPUT_MARK6     4
+#define INPUT_SYNTH     5
 
 #define ENC_VLBA    0
 #define ENC_AT      1
 
+#define DEVICE_GPU          0
+#define DEVICE_CPU          1
+#define DEVICE_ACCELERATOR  2
+#define DEVICE_ALL          3
+
+// Module state (kernels, plans, bound buffers) is held per worker thread, as
+// each worker drives its own device and context
+#define WORKER_LOCAL __thread
+
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+// Number of modules timed in each loop (read, H->D, convert, FFT, sum,
+// waterfall, fold and dedispersion)
+#define STAGES  8
 
 typedef struct
 {
-    int     device_id;      // OpenCL device id
-    int     input_type;     // Input type (stdin, file or network)
+    int     *device_ids;    // Selected OpenCL device ids
+    int     n_device_ids;   // Number of selected devices (-1 for all)
+    int     device_type;    // Device type to search for
+    char    *device_name;   // Substring the device names must contain
+    int     input_type;     // Input type (stdin, file, network, Mark6 or
+                            // synthetic)
     char    *input_file;    // Input filename
+    char    **mark6_files;  // Files of a Mark6 recording, one per disk
+    int     n_mark6_files;  // Number of Mark6 files
     int     port;           // Port to use for network transfer
     int     loops;          // Number of loops to perform
     int     n;              // Total number of samples per loop
@@ -24,4 +46,64 @@ typedef struct
     int     batch_size;     // FFT batch size
     int     bins;           // Number of FFT bins
     int     output_length;  // Total output length
+    int     packed;         // Pack two real channels into each complex FFT
+    int     data_length;    // Number of complex samples in dev_data per loop
+    long long offset;       // Byte offset into the input to start from
+    long long length;       // Number of bytes of input to process
+    char    *partial_file;  // Output filename for the partial spectrum
+    char    *metrics_file;  // Filename the metrics are periodically written to
+    double  metrics_interval;   // Seconds between metrics updates
+    int     superbatch;     // Loops per kernel launch (0 for automatic)
+    char    *waterfall_file;    // Output filename for the waterfall
+    int     decimate;       // FFT frames averaged into each waterfall row
+    int     waterfall_rows; // Waterfall rows per loop
+    char    *input2_file;   // Second input filename for cross-correlation
+    char    *delay_model;   // Delay model filename for cross-correlation
+    int     spectra;        // Number of spectra in the output
+    char    *trace_file;    // Output filename for the Chrome trace
+    double  noise;          // Standard deviation of the synthetic noise
+    float   *tones;         // Synthetic tones (channel, bin, amplitude, 0)
+    int     n_tones;        // Number of synthetic tones
+    int     zoom;           // Zoom decimation factor (1 when not zoomed)
+    char    *zoom_bands;    // Zoom band centres as given on the command line
+    float   *zoom_centre;   // Zoom band centre of each channel, in cycles per
+                            // sample
+    int     zoom_taps;      // Length of the zoom low-pass filter
+    int     history;        // Bytes of input preceding each launch which are
+                            // also transferred to the device
+    double  rate;           // Samples per second of each channel
+    double  integration;    // Integration time to plan for, in seconds
+    double  latency;        // Latency budget for each launch, in seconds
+    char    *select_ranges; // Selected bin ranges as given on the command line
+    int     *select_map;    // First input bin and number of bins averaged for
+                            // each selected output bin
+    int     select_length;  // Selected output bins per channel (0 for all)
+    int     dump_length;    // Complex values per spectrum copied back
+    int     *numa_nodes;    // NUMA node of each selected device
+    int     n_numa_nodes;   // Number of NUMA nodes given
+    int     reader_node;    // NUMA node of the reader threads (-1 for any)
+    int     split_numa;     // Split CPU devices into one per NUMA node
+    char    *fold_file;     // Output filename for the folded spectra
+    double  *ephemeris;     // Pulse phase polynomial, in turns, of the
+                            // seconds since the start of the stream
+    int     n_ephemeris;    // Number of ephemeris coefficients
+    int     phase_bins;     // Pulse phase bins to fold into
+    char    *trigger_file;  // Output filename for the transient candidates
+    double  dm_low;         // Lowest trial DM, in pc cm^-3
+    double  dm_step;        // Step between trial DMs
+    int     n_dm;           // Number of trial DMs
+    double  freq;           // Lower edge of the first channel, in MHz
+    double  channel_width;  // Bandwidth of each channel, in MHz
+    double  snr_threshold;  // S/N above which candidates are reported
+    int     *resolutions;   // FFT bins of each additional resolution
+    int     *resolution_lengths;    // Output length of each additional
+                                    // resolution
+    int     n_resolutions;  // Number of additional resolutions
+    int     resolutions_length; // Total output length of the additional
+                                // resolutions
+    int     compress_threads;   // Threads compressing the waterfall (0 to
+                                // write it uncompressed)
+    char    *record_file;   // Output filename for a copy of the raw input
+    double  latency_target; // End-to-end latency target per loop, in ms (0
+                            // to optimise for throughput)
 } ga_settings;
@@ -0,0 +1,406 @@
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "main.h"
+#include "mark6.h"
+#include "metrics.h"
+
+// Mark6 scatter-gather files start with a file header carrying this sync word,
+// followed by blocks which each have a block header
+#define MARK6_SYNC_WORD     0xfeed6666
+#define MARK6_VERSION       2
+
+// Blocks which may be held in the reorder ring for each disk
+#define MARK6_SLOTS_PER_DISK 4
+
+typedef struct
+{
+    uint32_t    sync_word;
+    int32_t     version;
+    int32_t     block_size;     // Largest block, including its header
+    int32_t     packet_format;
+    int32_t     packet_size;
+} mark6_file_header;
+
+typedef struct
+{
+    int32_t     blocknum;       // Position of the block in the stream
+    int32_t     wb_size;        // Size of the block, including this header
+} mark6_block_header;
+
+typedef struct
+{
+    FILE        *fp;
+    char        *filename;
+    int         blocknum;       // Next block to be read, or -1 at EOF
+    int         size;           // Payload size of that block
+    int         waiting;        // Whether the reader is waiting for a slot
+    long long   bytes;
+    pthread_t   thread;
+} mark6_disk;
+
+typedef struct
+{
+    char        *data;
+    int         blocknum;       // Block held in the slot, or -1 if empty
+    int         size;
+    int         ready;          // Whether the block has been read in full
+} mark6_slot;
+
+mark6_disk      *mark6_disks;
+int             mark6_n_disks;
+mark6_slot      *mark6_slots;
+int             mark6_n_slots;
+int             mark6_block_size;
+int             mark6_next;
+int             mark6_pos;
+int             mark6_stop;
+long long       mark6_blocks;
+long long       mark6_missing;
+
+pthread_mutex_t mark6_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  mark6_filled = PTHREAD_COND_INITIALIZER;
+pthread_cond_t  mark6_freed = PTHREAD_COND_INITIALIZER;
+
+/*
+ * Reads the header of the next block on a disk, returning the block number
+ * and payload size, or -1 at the end of the file.
+ */
+int mark6_next_block(mark6_disk *d, int block_size, int *size)
+{
+    mark6_block_header  header;
+
+    if (fread(&header, sizeof(header), 1, d->fp) != 1)
+    {
+        return -1;
+    }
+
+    *size = header.wb_size - (int)sizeof(header);
+
+    if (header.blocknum < 0 || *size < 0 || *size > block_size)
+    {
+        fprintf(stderr, "%s: Invalid block header (block %d, %d bytes)\n",
+            d->filename, header.blocknum, header.wb_size);
+        exit(EXIT_FAILURE);
+    }
+
+    return header.blocknum;
+}
+
+/*
+ * Reads the blocks of one disk into the reorder ring. Each block goes in the
+ * slot given by its block number, once the consumer is close enough for that
+ * slot to be free, so the disks can run ahead of each other by up to the size
+ * of the ring.
+ */
+void *mark6_reader(void *arg)
+{
+    mark6_disk  *d = arg;
+
+    pthread_mutex_lock(&mark6_lock);
+
+    while (d->blocknum >= 0 && !mark6_stop)
+    {
+        mark6_slot  *slot = &mark6_slots[d->blocknum % mark6_n_slots];
+        char        *dest = NULL;
+
+        if (d->blocknum >= mark6_next)
+        {
+            // Wait until the consumer has released the slot for this block.
+            // The consumer is woken first, as it may be waiting on a block
+            // which none of the disks hold.
+            while (!mark6_stop && d->blocknum >= mark6_next &&
+                (slot->blocknum >= 0 ||
+                d->blocknum >= mark6_next + mark6_n_slots))
+            {
+                d->waiting = 1;
+                pthread_cond_broadcast(&mark6_filled);
+                pthread_cond_wait(&mark6_freed, &mark6_lock);
+            }
+            d->waiting = 0;
+
+            if (mark6_stop)
+            {
+                break;
+            }
+
+            // The block may have been given up on while waiting
+            if (d->blocknum >= mark6_next)
+            {
+                slot->blocknum = d->blocknum;
+                slot->size = d->size;
+                slot->ready = 0;
+                dest = slot->data;
+            }
+        }
+
+        pthread_mutex_unlock(&mark6_lock);
+
+        // Read the payload, or skip over it if it arrived too late to be used
+        int ok;
+        if (dest != NULL)
+        {
+            ok = fread(dest, 1, d->size, d->fp) == (size_t)d->size;
+        }
+        else
+        {
+            ok = fseeko(d->fp, d->size, SEEK_CUR) == 0;
+        }
+
+        int size = 0;
+        int blocknum = ok ? mark6_next_block(d, mark6_block_size, &size) : -1;
+
+        pthread_mutex_lock(&mark6_lock);
+
+        if (dest != NULL)
+        {
+            if (ok)
+            {
+                slot->ready = 1;
+                d->bytes += d->size;
+                metrics_add(METRIC_RING_BLOCKS, 1);
+            }
+            else
+            {
+                // A truncated block is treated as missing
+                fprintf(stderr, "%s: Block %d is truncated\n", d->filename,
+                    d->blocknum);
+                slot->blocknum = -1;
+            }
+        }
+
+        d->blocknum = blocknum;
+        d->size = size;
+        pthread_cond_broadcast(&mark6_filled);
+    }
+
+    d->waiting = 0;
+    pthread_mutex_unlock(&mark6_lock);
+
+    return NULL;
+}
+
+/*
+ * Opens the file on each disk of a Mark6 scatter-gather recording and starts
+ * one reader thread per disk. The stream starts at the lowest block number
+ * found on any disk.
+ */
+void mark6_open(ga_settings *settings)
+{
+    mark6_file_header   header;
+
+    mark6_n_disks = settings->n_mark6_files;
+    mark6_disks = calloc(mark6_n_disks, sizeof(mark6_disk));
+    mark6_next = INT_MAX;
+
+    for (int i = 0; i < mark6_n_disks; i++)
+    {
+        mark6_disk *d = &mark6_disks[i];
+
+        d->filename = settings->mark6_files[i];
+        d->fp = fopen(d->filename, "r");
+
+        if (d->fp == NULL)
+        {
+            fprintf(stderr, "%s: ", d->filename);
+            perror("");
+            exit(EXIT_FAILURE);
+        }
+
+        if (fread(&header, sizeof(header), 1, d->fp) != 1 ||
+            header.sync_word != MARK6_SYNC_WORD)
+        {
+            fprintf(stderr, "%s: Not a Mark6 scatter-gather file\n",
+                d->filename);
+            exit(EXIT_FAILURE);
+        }
+
+        if (header.version != MARK6_VERSION)
+        {
+            fprintf(stderr, "%s: Unsupported Mark6 file version %d\n",
+                d->filename, header.version);
+            exit(EXIT_FAILURE);
+        }
+
+        // Every disk of a recording uses the same block size
+        if (i == 0)
+        {
+            mark6_block_size = header.block_size;
+        }
+        else if (header.block_size != mark6_block_size)
+        {
+            fprintf(stderr, "%s: Block size of %d bytes does not match %d "
+                "bytes\n", d->filename, header.block_size, mark6_block_size);
+            exit(EXIT_FAILURE);
+        }
+
+        d->blocknum = mark6_next_block(d, mark6_block_size, &d->size);
+
+        if (d->blocknum >= 0)
+        {
+            mark6_next = MIN(mark6_next, d->blocknum);
+        }
+    }
+
+    if (mark6_next == INT_MAX)
+    {
+        mark6_next = 0;
+    }
+
+    // Set up the reorder ring
+    mark6_n_slots = MARK6_SLOTS_PER_DISK*mark6_n_disks;
+    mark6_slots = malloc(mark6_n_slots*sizeof(mark6_slot));
+
+    for (int i = 0; i < mark6_n_slots; i++)
+    {
+        mark6_slots[i].data = malloc(mark6_block_size);
+        mark6_slots[i].blocknum = -1;
+        mark6_slots[i].size = 0;
+        mark6_slots[i].ready = 0;
+    }
+
+    for (int i = 0; i < mark6_n_disks; i++)
+    {
+        pthread_create(&mark6_disks[i].thread, NULL, mark6_reader,
+            &mark6_disks[i]);
+    }
+}
+
+/*
+ * Copies the next n_bytes of the reassembled stream into h_data, or discards
+ * them if h_data is NULL. Blocks which are not on any disk are skipped.
+ * Returns the number of bytes copied, which is less than n_bytes at the end
+ * of the recording.
+ */
+int mark6_read(unsigned int *h_data, int n_bytes)
+{
+    int copied = 0;
+
+    pthread_mutex_lock(&mark6_lock);
+
+    while (copied < n_bytes)
+    {
+        mark6_slot *slot = &mark6_slots[mark6_next % mark6_n_slots];
+
+        if (slot->blocknum == mark6_next && slot->ready)
+        {
+            // Only the consumer uses a full slot, so copy without the lock
+            int n = MIN(slot->size - mark6_pos, n_bytes - copied);
+
+            pthread_mutex_unlock(&mark6_lock);
+            if (h_data != NULL)
+            {
+                memcpy((char *)h_data + copied, slot->data + mark6_pos, n);
+            }
+            pthread_mutex_lock(&mark6_lock);
+
+            copied += n;
+            mark6_pos += n;
+
+            // Release the slot once the whole block has been used
+            if (mark6_pos == slot->size)
+            {
+                slot->blocknum = -1;
+                mark6_next++;
+                mark6_pos = 0;
+                mark6_blocks++;
+                metrics_add(METRIC_RING_BLOCKS, -1);
+                pthread_cond_broadcast(&mark6_freed);
+            }
+
+            continue;
+        }
+
+        // Find the lowest block still to come, and whether any reader could
+        // yet deliver the block wanted
+        int lowest = INT_MAX;
+        int stalled = slot->blocknum != mark6_next;
+
+        for (int i = 0; i < mark6_n_disks; i++)
+        {
+            if (mark6_disks[i].blocknum >= 0)
+            {
+                if (!mark6_disks[i].waiting)
+                {
+                    stalled = 0;
+                }
+                lowest = MIN(lowest, mark6_disks[i].blocknum);
+            }
+        }
+
+        for (int i = 0; i < mark6_n_slots; i++)
+        {
+            if (mark6_slots[i].blocknum >= 0)
+            {
+                lowest = MIN(lowest, mark6_slots[i].blocknum);
+            }
+        }
+
+        if (!stalled)
+        {
+            pthread_cond_wait(&mark6_filled, &mark6_lock);
+        }
+        else if (lowest == mark6_next)
+        {
+            // A reader holds the block wanted and has been woken to fill its
+            // slot, but only stops waiting once it has the lock
+            pthread_cond_wait(&mark6_filled, &mark6_lock);
+        }
+        else if (lowest == INT_MAX)
+        {
+            // Every disk has reached EOF
+            break;
+        }
+        else
+        {
+            // The block was never recorded, so continue from the next one
+            mark6_missing += lowest - mark6_next;
+            mark6_next = lowest;
+            mark6_pos = 0;
+            pthread_cond_broadcast(&mark6_freed);
+        }
+    }
+
+    pthread_mutex_unlock(&mark6_lock);
+
+    return copied;
+}
+
+/*
+ * Stops the reader threads, closes the disk files and reports how much was
+ * read from each disk.
+ */
+void mark6_close(void)
+{
+    pthread_mutex_lock(&mark6_lock);
+    mark6_stop = 1;
+    pthread_cond_broadcast(&mark6_freed);
+    pthread_mutex_unlock(&mark6_lock);
+
+    fprintf(stderr, "-- Mark6: %lld blocks from %d disks, %lld missing\n",
+        mark6_blocks, mark6_n_disks, mark6_missing);
+
+    for (int i = 0; i < mark6_n_disks; i++)
+    {
+        pthread_join(mark6_disks[i].thread, NULL);
+        fclose(mark6_disks[i].fp);
+
+        fprintf(stderr, "--     [Disk %d] bytes:\t%lld\n", i,
+            mark6_disks[i].bytes);
+    }
+
+    for (int i = 0; i < mark6_n_slots; i++)
+    {
+        free(mark6_slots[i].data);
+    }
+
+    free(mark6_slots);
+    free(mark6_disks);
+}
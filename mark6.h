@@ -0,0 +1,3 @@
+void mark6_open(ga_settings *settings);
+int mark6_read(unsigned int *h_data, int n_bytes);
+void mark6_close(void);
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "main.h"
+#include "partial.h"
+
+/*
+ * Sums partial spectra produced by clauto --partial over disjoint time ranges
+ * of the same recording. The merged spectrum is printed in the same format as
+ * clauto, or written as another partial spectrum with -o.
+ */
+int main(int argc, char *argv[])
+{
+    int             c;
+    char            *output_file = NULL;
+    partial_header  merged;
+    partial_header  header;
+    float           *spectrum = NULL;
+    float           *part;
+    long long       *offsets;
+    long long       *ends;
+
+    for (;;)
+    {
+        c = getopt(argc, argv, "o:");
+
+        // No more options, exit the loop
+        if (c == -1)
+        {
+            break;
+        }
+
+        if (c == 'o')
+        {
+            output_file = optarg;
+        }
+        else
+        {
+            fprintf(stderr, "Invalid command-line options supplied\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind == argc)
+    {
+        fprintf(stderr, "Usage: %s [-o output] partial...\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int n_parts = argc - optind;
+    offsets = malloc(n_parts*sizeof(long long));
+    ends = malloc(n_parts*sizeof(long long));
+
+    for (int i = 0; i < n_parts; i++)
+    {
+        char *filename = argv[optind + i];
+        part = partial_read(filename, &header);
+
+        if (spectrum == NULL)
+        {
+            // The first partial spectrum sets the expected dimensions
+            merged = header;
+            merged.loops = 0;
+            spectrum = calloc(2*header.output_length, sizeof(float));
+        }
+        else if (header.bins != merged.bins ||
+            header.channels != merged.channels || header.spc != merged.spc ||
+            header.bytes != merged.bytes ||
+            header.output_length != merged.output_length)
+        {
+            fprintf(stderr, "%s: Dimensions do not match %s\n", filename,
+                argv[optind]);
+            exit(EXIT_FAILURE);
+        }
+
+        // Accumulate the spectrum and the integration count
+        for (int j = 0; j < 2*header.output_length; j++)
+        {
+            spectrum[j] += part[j];
+        }
+        merged.loops += header.loops;
+        merged.offset = MIN(merged.offset, header.offset);
+
+        // Remember the byte range for the overlap check
+        offsets[i] = header.offset;
+        ends[i] = header.offset + header.loops*header.bytes;
+
+        for (int j = 0; j < i; j++)
+        {
+            if (offsets[i] < ends[j] && offsets[j] < ends[i])
+            {
+                fprintf(stderr, "Warning: %s overlaps %s\n", filename,
+                    argv[optind + j]);
+            }
+        }
+
+        free(part);
+    }
+
+    fprintf(stderr, "Merged %d partial spectra (%lld loops)\n", n_parts,
+        merged.loops);
+
+    if (output_file != NULL)
+    {
+        partial_write(output_file, &merged, spectrum);
+    }
+    else
+    {
+        // Print the result, a row per channel as clauto does. The partial
+        // holds the dumped spectrum, so a row is every bin when zoomed and
+        // only the selected bins with --select, rather than bins/2
+        for (int i = 0; i < merged.output_length; i++)
+        {
+            if (i % (merged.output_length/merged.channels) == 0)
+            {
+                printf("\n");
+            }
+
+            printf("%f\n", spectrum[2*i]);
+        }
+    }
+
+    free(spectrum);
+    free(offsets);
+    free(ends);
+
+    return 0;
+}
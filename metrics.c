@@ -0,0 +1,222 @@
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "main.h"
+#include "metrics.h"
+
+// Names of the modules timed in each loop, in the order of METRIC_STAGE_US
+char *stage_names[] = {"read", "h2d", "convert", "fft", "sum",
+    "waterfall", "fold", "dedisperse"};
+
+// Counters, only ever updated with atomic adds
+long long       metrics[METRIC_COUNT];
+int             metrics_enabled;
+
+char            *metrics_file;
+double          metrics_interval;
+int             metrics_running;
+pthread_t       metrics_thread;
+pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  metrics_wake = PTHREAD_COND_INITIALIZER;
+
+/*
+ * Adds value to a counter. This is a single atomic add, so it is safe to call
+ * from any worker without locking and costs nothing when metrics are off.
+ */
+void metrics_add(int metric, long long value)
+{
+    if (metrics_enabled)
+    {
+        __sync_fetch_and_add(&metrics[metric], value);
+    }
+}
+
+/*
+ * Reads a counter atomically.
+ */
+long long metrics_get(int metric)
+{
+    return __sync_fetch_and_add(&metrics[metric], 0);
+}
+
+/*
+ * Writes the current counters to the metrics file in the Prometheus text
+ * format. The file is written under a temporary name and renamed, so readers
+ * never see a partially written file.
+ */
+void metrics_write(double samples_rate, double bytes_rate)
+{
+    char    *tmp_file = malloc(strlen(metrics_file) + 5);
+    FILE    *fp;
+
+    sprintf(tmp_file, "%s.tmp", metrics_file);
+    fp = fopen(tmp_file, "w");
+
+    if (fp == NULL)
+    {
+        fprintf(stderr, "%s: ", tmp_file);
+        perror("");
+        free(tmp_file);
+        return;
+    }
+
+    fprintf(fp, "# HELP clauto_samples_total Samples processed, summed over "
+        "channels.\n");
+    fprintf(fp, "# TYPE clauto_samples_total counter\n");
+    fprintf(fp, "clauto_samples_total %lld\n", metrics_get(METRIC_SAMPLES));
+
+    fprintf(fp, "# HELP clauto_samples_per_second Sample rate over the last "
+        "interval.\n");
+    fprintf(fp, "# TYPE clauto_samples_per_second gauge\n");
+    fprintf(fp, "clauto_samples_per_second %.1f\n", samples_rate);
+
+    fprintf(fp, "# HELP clauto_read_bytes_total Bytes read from the input.\n");
+    fprintf(fp, "# TYPE clauto_read_bytes_total counter\n");
+    fprintf(fp, "clauto_read_bytes_total %lld\n",
+        metrics_get(METRIC_BYTES_READ));
+
+    fprintf(fp, "# HELP clauto_read_bytes_per_second Reader bandwidth over "
+        "the last interval.\n");
+    fprintf(fp, "# TYPE clauto_read_bytes_per_second gauge\n");
+    fprintf(fp, "clauto_read_bytes_per_second %.1f\n", bytes_rate);
+
+    fprintf(fp, "# HELP clauto_loops_total Loops completed.\n");
+    fprintf(fp, "# TYPE clauto_loops_total counter\n");
+    fprintf(fp, "clauto_loops_total %lld\n", metrics_get(METRIC_LOOPS));
+
+    fprintf(fp, "# HELP clauto_stage_seconds_total Time spent in each "
+        "module, summed over devices.\n");
+    fprintf(fp, "# TYPE clauto_stage_seconds_total counter\n");
+    for (int i = 0; i < STAGES; i++)
+    {
+        fprintf(fp, "clauto_stage_seconds_total{stage=\"%s\"} %.6f\n",
+            stage_names[i], metrics_get(METRIC_STAGE_US + i)/1e6);
+    }
+
+    fprintf(fp, "# HELP clauto_busy_workers Workers currently processing a "
+        "loop.\n");
+    fprintf(fp, "# TYPE clauto_busy_workers gauge\n");
+    fprintf(fp, "clauto_busy_workers %lld\n",
+        metrics_get(METRIC_BUSY_WORKERS));
+
+    fprintf(fp, "# HELP clauto_ring_blocks Input blocks waiting in the "
+        "reorder ring.\n");
+    fprintf(fp, "# TYPE clauto_ring_blocks gauge\n");
+    fprintf(fp, "clauto_ring_blocks %lld\n", metrics_get(METRIC_RING_BLOCKS));
+
+    fprintf(fp, "# HELP clauto_dumps_total Spectra copied back to the "
+        "host.\n");
+    fprintf(fp, "# TYPE clauto_dumps_total counter\n");
+    fprintf(fp, "clauto_dumps_total %lld\n", metrics_get(METRIC_DUMPS));
+
+    fprintf(fp, "# HELP clauto_dump_seconds_total Time spent copying spectra "
+        "back to the host.\n");
+    fprintf(fp, "# TYPE clauto_dump_seconds_total counter\n");
+    fprintf(fp, "clauto_dump_seconds_total %.6f\n",
+        metrics_get(METRIC_DUMP_US)/1e6);
+
+    fprintf(fp, "# HELP clauto_record_bytes_total Input bytes recorded to "
+        "disk.\n");
+    fprintf(fp, "# TYPE clauto_record_bytes_total counter\n");
+    fprintf(fp, "clauto_record_bytes_total %lld\n",
+        metrics_get(METRIC_RECORD_BYTES));
+
+    fprintf(fp, "# HELP clauto_record_dropped_loops_total Loops processed but "
+        "not recorded as the disk fell behind.\n");
+    fprintf(fp, "# TYPE clauto_record_dropped_loops_total counter\n");
+    fprintf(fp, "clauto_record_dropped_loops_total %lld\n",
+        metrics_get(METRIC_RECORD_DROPS));
+
+    fclose(fp);
+
+    if (rename(tmp_file, metrics_file) != 0)
+    {
+        fprintf(stderr, "%s: ", metrics_file);
+        perror("");
+    }
+
+    free(tmp_file);
+}
+
+/*
+ * Rewrites the metrics file every interval until metrics_terminate is called,
+ * then writes it once more with the final counts.
+ */
+void *metrics_writer(void *arg)
+{
+    struct timeval  now;
+    struct timespec deadline;
+    long long       last_samples = 0;
+    long long       last_bytes = 0;
+
+    pthread_mutex_lock(&metrics_lock);
+
+    do
+    {
+        // Sleep until the next interval or until woken for termination
+        if (metrics_running)
+        {
+            gettimeofday(&now, NULL);
+            double t = now.tv_sec + now.tv_usec/1e6 + metrics_interval;
+            deadline.tv_sec = (time_t)t;
+            deadline.tv_nsec = (long)((t - deadline.tv_sec)*1e9);
+            pthread_cond_timedwait(&metrics_wake, &metrics_lock, &deadline);
+        }
+
+        // Work out the rates over the last interval
+        long long samples = metrics_get(METRIC_SAMPLES);
+        long long bytes = metrics_get(METRIC_BYTES_READ);
+
+        metrics_write((samples - last_samples)/metrics_interval,
+            (bytes - last_bytes)/metrics_interval);
+
+        last_samples = samples;
+        last_bytes = bytes;
+    } while (metrics_running);
+
+    pthread_mutex_unlock(&metrics_lock);
+
+    return NULL;
+}
+
+/*
+ * Starts the metrics writer if a metrics file was requested.
+ */
+void metrics_initialise(ga_settings *settings)
+{
+    if (settings->metrics_file == NULL)
+    {
+        return;
+    }
+
+    metrics_file = settings->metrics_file;
+    metrics_interval = settings->metrics_interval;
+    metrics_enabled = 1;
+    metrics_running = 1;
+
+    pthread_create(&metrics_thread, NULL, metrics_writer, NULL);
+}
+
+/*
+ * Stops the metrics writer, which writes the metrics file one last time.
+ */
+void metrics_terminate(void)
+{
+    if (!metrics_enabled)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&metrics_lock);
+    metrics_running = 0;
+    pthread_cond_signal(&metrics_wake);
+    pthread_mutex_unlock(&metrics_lock);
+
+    pthread_join(metrics_thread, NULL);
+}
@@ -0,0 +1,15 @@
+#define METRIC_SAMPLES      0
+#define METRIC_BYTES_READ   1
+#define METRIC_LOOPS        2
+#define METRIC_STAGE_US     3   // One counter per module, STAGES in total
+#define METRIC_DUMPS        11
+#define METRIC_DUMP_US      12
+#define METRIC_BUSY_WORKERS 13
+#define METRIC_RING_BLOCKS  14
+#define METRIC_RECORD_BYTES 15
+#define METRIC_RECORD_DROPS 16
+#define METRIC_COUNT        17
+
+void metrics_initialise(ga_settings *settings);
+void metrics_add(int metric, long long value);
+void metrics_terminate(void);
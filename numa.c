@@ -0,0 +1,154 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/syscall.h>
+
+#include "main.h"
+#include "numa.h"
+
+// The topology is read from sysfs, so no NUMA library is needed
+#define NUMA_SYSFS  "/sys/devices/system/node"
+
+// Memory policy for mbind, from linux/mempolicy.h
+#define NUMA_MPOL_BIND  2
+
+#define NUMA_PAGE   4096
+
+// The CPUs each thread could run on before it was bound to a node
+WORKER_LOCAL cpu_set_t  numa_unbound;
+
+/*
+ * Returns the number of NUMA nodes, which is 1 on machines without NUMA.
+ */
+int numa_node_count(void)
+{
+    char    path[64];
+    int     n = 0;
+
+    for (;;)
+    {
+        sprintf(path, NUMA_SYSFS "/node%d", n);
+
+        if (access(path, F_OK) != 0)
+        {
+            break;
+        }
+
+        n++;
+    }
+
+    return n > 0 ? n : 1;
+}
+
+/*
+ * Returns the list of CPUs on a node in the kernel's format, e.g. "0-15,32-47".
+ * The string is allocated and must be freed.
+ */
+char *numa_cpulist(int node)
+{
+    char    path[64];
+    char    *list = malloc(4096);
+    FILE    *fp;
+
+    sprintf(path, NUMA_SYSFS "/node%d/cpulist", node);
+    fp = fopen(path, "r");
+
+    if (fp == NULL || fgets(list, 4096, fp) == NULL)
+    {
+        fprintf(stderr, "%s: ", path);
+        perror("");
+        exit(EXIT_FAILURE);
+    }
+
+    fclose(fp);
+    list[strcspn(list, "\n")] = '\0';
+
+    return list;
+}
+
+/*
+ * Restricts the calling thread to the CPUs of a node. Threads it creates
+ * afterwards, including those of an OpenCL runtime, inherit the restriction.
+ * The previous CPUs are kept for numa_unbind_thread.
+ */
+void numa_bind_thread(int node)
+{
+    cpu_set_t   set;
+    char        *list = numa_cpulist(node);
+    char        *tok;
+
+    CPU_ZERO(&set);
+
+    for (tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ","))
+    {
+        int first, last;
+
+        if (sscanf(tok, "%d-%d", &first, &last) != 2)
+        {
+            last = first = atoi(tok);
+        }
+
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+        {
+            CPU_SET(cpu, &set);
+        }
+    }
+
+    free(list);
+
+    if (sched_getaffinity(0, sizeof(numa_unbound), &numa_unbound) != 0 ||
+        sched_setaffinity(0, sizeof(set), &set) != 0)
+    {
+        perror("sched_setaffinity");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Lets the calling thread run on the CPUs it could before numa_bind_thread.
+ * Threads it has already created stay on the node.
+ */
+void numa_unbind_thread(void)
+{
+    if (sched_setaffinity(0, sizeof(numa_unbound), &numa_unbound) != 0)
+    {
+        perror("sched_setaffinity");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Allocates a host buffer on a node. The pages are bound to the node where
+ * the kernel allows it, and are touched so they are placed immediately rather
+ * than on first use. With node -1 the buffer is only page aligned, which
+ * also suits O_DIRECT.
+ */
+void *numa_alloc(size_t n_bytes, int node)
+{
+    void            *ptr;
+    unsigned long   mask[16] = {0};
+
+    if (posix_memalign(&ptr, NUMA_PAGE, n_bytes) != 0)
+    {
+        fprintf(stderr, "Unable to allocate %zu bytes\n", n_bytes);
+        exit(EXIT_FAILURE);
+    }
+
+    if (node < 0)
+    {
+        return ptr;
+    }
+
+    // A failure only means the buffer is placed by the calling thread
+    mask[node/(8*sizeof(long))] |= 1UL << (node%(8*sizeof(long)));
+    syscall(SYS_mbind, ptr, (n_bytes + NUMA_PAGE - 1)/NUMA_PAGE*NUMA_PAGE,
+        NUMA_MPOL_BIND, mask, 8*sizeof(mask), 0);
+
+    memset(ptr, 0, n_bytes);
+
+    return ptr;
+}
@@ -0,0 +1,5 @@
+int numa_node_count(void);
+char *numa_cpulist(int node);
+void numa_bind_thread(int node);
+void numa_unbind_thread(void);
+void *numa_alloc(size_t n_bytes, int node);
@@ -15,8 +15,15 @@ void options(int argc, char *argv[], ga_settings *settings)
     int fail = 0;
 
     // Default settings
-    settings->device_id = -1;
+    settings->device_type = DEVICE_GPU;
+    settings->metrics_interval = 1.0;
+    settings->superbatch = 1;
     settings->input_type = INPUT_NONE;
+    settings->noise = 1.0;
+    settings->zoom = 1;
+    settings->reader_node = -1;
+    settings->phase_bins = 32;
+    settings->snr_threshold = 6.0;
 
     for (;;)
     {
@@ -33,6 +40,44 @@ void options(int argc, char *argv[], ga_settings *settings)
             {"loops", required_argument, NULL, 'g'},
             {"encoding", required_argument, NULL, 'e'},
             {"channels", required_argument, NULL, 'c'},
+            {"packed", no_argument, NULL, 258},
+            {"offset", required_argument, NULL, 259},
+            {"length", required_argument, NULL, 260},
+            {"partial", required_argument, NULL, 261},
+            {"device-type", required_argument, NULL, 262},
+            {"device-name", required_argument, NULL, 263},
+            {"metrics", required_argument, NULL, 264},
+            {"metrics-interval", required_argument, NULL, 265},
+            {"superbatch", required_argument, NULL, 266},
+            {"waterfall", required_argument, NULL, 267},
+            {"decimate", required_argument, NULL, 268},
+            {"input2", required_argument, NULL, 269},
+            {"delay-model", required_argument, NULL, 270},
+            {"trace", required_argument, NULL, 271},
+            {"mark6", required_argument, NULL, 272},
+            {"synth", no_argument, NULL, 273},
+            {"tone", required_argument, NULL, 274},
+            {"noise", required_argument, NULL, 275},
+            {"zoom", required_argument, NULL, 276},
+            {"zoom-band", required_argument, NULL, 277},
+            {"rate", required_argument, NULL, 278},
+            {"integration", required_argument, NULL, 279},
+            {"latency", required_argument, NULL, 280},
+            {"select", required_argument, NULL, 281},
+            {"numa", required_argument, NULL, 282},
+            {"reader-node", required_argument, NULL, 283},
+            {"split-numa", no_argument, NULL, 284},
+            {"fold", required_argument, NULL, 285},
+            {"ephemeris", required_argument, NULL, 286},
+            {"phase-bins", required_argument, NULL, 287},
+            {"triggers", required_argument, NULL, 288},
+            {"dm", required_argument, NULL, 289},
+            {"freq", required_argument, NULL, 290},
+            {"snr", required_argument, NULL, 291},
+            {"resolutions", required_argument, NULL, 292},
+            {"compress", required_argument, NULL, 293},
+            {"record", required_argument, NULL, 294},
+            {"latency-target", required_argument, NULL, 295},
             {NULL, 0, NULL, 0}
         };
 
@@ -50,7 +95,22 @@ void options(int argc, char *argv[], ga_settings *settings)
         switch (c)
         {
             case 'd':
-                settings->device_id = atoi(optarg);
+                if (strcmp(optarg, "all") == 0)
+                {
+                    settings->n_device_ids = -1;
+                    break;
+                }
+
+                // Parse a comma separated list of device ids
+                settings->n_device_ids = 0;
+                for (char *tok = strtok(optarg, ","); tok != NULL;
+                    tok = strtok(NULL, ","))
+                {
+                    settings->device_ids = realloc(settings->device_ids,
+                        (settings->n_device_ids + 1)*sizeof(int));
+                    settings->device_ids[settings->n_device_ids++] =
+                        atoi(tok);
+                }
                 break;
 
             case 256:
@@ -75,6 +135,186 @@ void options(int argc, char *argv[], ga_settings *settings)
                 strcpy(settings->input_file, optarg);
                 break;
 
+            case 272:
+                if (settings->input_type != INPUT_NONE)
+                {
+                    fprintf(stderr, "Input type has been specified multiple "
+                        "times\n");
+                    exit(EXIT_FAILURE);
+                }
+                settings->input_type = INPUT_MARK6;
+
+                // Comma-separated list of the files on each disk
+                for (char *tok = strtok(optarg, ","); tok != NULL;
+                    tok = strtok(NULL, ","))
+                {
+                    settings->mark6_files = realloc(settings->mark6_files,
+                        (settings->n_mark6_files + 1)*sizeof(char *));
+                    settings->mark6_files[settings->n_mark6_files++] = tok;
+                }
+                break;
+
+            case 273:
+                if (settings->input_type != INPUT_NONE)
+                {
+                    fprintf(stderr, "Input type has been specified multiple "
+                        "times\n");
+                    exit(EXIT_FAILURE);
+                }
+                settings->input_type = INPUT_SYNTH;
+                break;
+
+            case 274:
+                // Each tone is given as channel:bin:amplitude
+                settings->tones = realloc(settings->tones,
+                    (settings->n_tones + 1)*4*sizeof(float));
+                float *tone = settings->tones + 4*settings->n_tones++;
+                tone[3] = 0;
+                if (sscanf(optarg, "%f:%f:%f", &tone[0], &tone[1],
+                    &tone[2]) != 3)
+                {
+                    fprintf(stderr, "Invalid tone: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 275:
+                settings->noise = atof(optarg);
+                break;
+
+            case 276:
+                settings->zoom = atoi(optarg);
+                break;
+
+            case 277:
+                settings->zoom_bands = malloc(strlen(optarg)+1);
+                strcpy(settings->zoom_bands, optarg);
+                break;
+
+            case 278:
+                settings->rate = atof(optarg);
+                break;
+
+            case 279:
+                settings->integration = atof(optarg);
+                break;
+
+            case 280:
+                settings->latency = atof(optarg);
+                break;
+
+            case 281:
+                settings->select_ranges = malloc(strlen(optarg)+1);
+                strcpy(settings->select_ranges, optarg);
+                break;
+
+            case 282:
+                // Comma-separated list of nodes, one per selected device
+                for (char *tok = strtok(optarg, ","); tok != NULL;
+                    tok = strtok(NULL, ","))
+                {
+                    settings->numa_nodes = realloc(settings->numa_nodes,
+                        (settings->n_numa_nodes + 1)*sizeof(int));
+                    settings->numa_nodes[settings->n_numa_nodes++] =
+                        atoi(tok);
+                }
+                break;
+
+            case 283:
+                settings->reader_node = atoi(optarg);
+                break;
+
+            case 284:
+                settings->split_numa = 1;
+                break;
+
+            case 285:
+                settings->fold_file = malloc(strlen(optarg)+1);
+                strcpy(settings->fold_file, optarg);
+                break;
+
+            case 286:
+                // Comma-separated coefficients, constant term first
+                for (char *tok = strtok(optarg, ","); tok != NULL;
+                    tok = strtok(NULL, ","))
+                {
+                    settings->ephemeris = realloc(settings->ephemeris,
+                        (settings->n_ephemeris + 1)*sizeof(double));
+                    settings->ephemeris[settings->n_ephemeris++] = atof(tok);
+                }
+                break;
+
+            case 287:
+                settings->phase_bins = atoi(optarg);
+                break;
+
+            case 288:
+                settings->trigger_file = malloc(strlen(optarg)+1);
+                strcpy(settings->trigger_file, optarg);
+                break;
+
+            case 289:
+            {
+                // Trial DMs as low:high:step
+                double dm_high;
+
+                if (sscanf(optarg, "%lf:%lf:%lf", &settings->dm_low, &dm_high,
+                    &settings->dm_step) != 3 || settings->dm_low < 0 ||
+                    dm_high < settings->dm_low || settings->dm_step <= 0)
+                {
+                    fprintf(stderr, "Invalid DM range: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                settings->n_dm = (int)((dm_high - settings->dm_low)/
+                    settings->dm_step + 0.5) + 1;
+                break;
+            }
+
+            case 290:
+                // Lower edge and width of each channel as freq:width in MHz
+                if (sscanf(optarg, "%lf:%lf", &settings->freq,
+                    &settings->channel_width) != 2 || settings->freq <= 0 ||
+                    settings->channel_width <= 0)
+                {
+                    fprintf(stderr, "Invalid frequency: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 291:
+                settings->snr_threshold = atof(optarg);
+                break;
+
+            case 292:
+                // Comma-separated list of log2 bins, as for -n
+                for (char *tok = strtok(optarg, ","); tok != NULL;
+                    tok = strtok(NULL, ","))
+                {
+                    settings->resolutions = realloc(settings->resolutions,
+                        (settings->n_resolutions + 1)*sizeof(int));
+                    settings->resolutions[settings->n_resolutions++] =
+                        1 << atoi(tok);
+                }
+                break;
+
+            case 293:
+                settings->compress_threads = atoi(optarg);
+                break;
+
+            case 294:
+                settings->record_file = malloc(strlen(optarg)+1);
+                strcpy(settings->record_file, optarg);
+                break;
+
+            case 295:
+                settings->latency_target = atof(optarg);
+                if (settings->latency_target <= 0)
+                {
+                    fprintf(stderr, "Latency target must be positive\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
             case 'p':
                 if (settings->input_type != INPUT_NONE)
                 {
@@ -123,6 +363,108 @@ void options(int argc, char *argv[], ga_settings *settings)
                 settings->channels = atoi(optarg);
                 break;
 
+            case 258:
+                settings->packed = 1;
+                break;
+
+            case 259:
+                settings->offset = strtoll(optarg, NULL, 10);
+                break;
+
+            case 260:
+                settings->length = strtoll(optarg, NULL, 10);
+                break;
+
+            case 261:
+                settings->partial_file = malloc(strlen(optarg)+1);
+                strcpy(settings->partial_file, optarg);
+                break;
+
+            case 262:
+                if (strcmp(optarg, "gpu") == 0)
+                {
+                    settings->device_type = DEVICE_GPU;
+                }
+                else if (strcmp(optarg, "cpu") == 0)
+                {
+                    settings->device_type = DEVICE_CPU;
+                }
+                else if (strcmp(optarg, "accelerator") == 0)
+                {
+                    settings->device_type = DEVICE_ACCELERATOR;
+                }
+                else if (strcmp(optarg, "all") == 0)
+                {
+                    settings->device_type = DEVICE_ALL;
+                }
+                else
+                {
+                    fprintf(stderr, "Device type must be one of: gpu, cpu, "
+                        "accelerator, all\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 263:
+                settings->device_name = malloc(strlen(optarg)+1);
+                strcpy(settings->device_name, optarg);
+                break;
+
+            case 264:
+                settings->metrics_file = malloc(strlen(optarg)+1);
+                strcpy(settings->metrics_file, optarg);
+                break;
+
+            case 265:
+                settings->metrics_interval = atof(optarg);
+                if (settings->metrics_interval <= 0)
+                {
+                    fprintf(stderr, "Metrics interval must be positive\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 266:
+                if (strcmp(optarg, "auto") == 0)
+                {
+                    settings->superbatch = 0;
+                }
+                else
+                {
+                    settings->superbatch = atoi(optarg);
+                    if (settings->superbatch < 1)
+                    {
+                        fprintf(stderr, "Super-batch size must be at least 1 "
+                            "or auto\n");
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                break;
+
+            case 267:
+                settings->waterfall_file = malloc(strlen(optarg)+1);
+                strcpy(settings->waterfall_file, optarg);
+                break;
+
+            case 268:
+                settings->decimate = atoi(optarg);
+                break;
+
+            case 269:
+                settings->input2_file = malloc(strlen(optarg)+1);
+                strcpy(settings->input2_file, optarg);
+                break;
+
+            case 270:
+                settings->delay_model = malloc(strlen(optarg)+1);
+                strcpy(settings->delay_model, optarg);
+                break;
+
+            case 271:
+                settings->trace_file = malloc(strlen(optarg)+1);
+                strcpy(settings->trace_file, optarg);
+                break;
+
             case '?':
             default:
                 fail = 1;
@@ -165,30 +507,97 @@ void options(int argc, char *argv[], ga_settings *settings)
         settings->input_type = INPUT_STDIN;
     }
 
-    // Ensure spc, batch_size and bins are all specified
+    // The zoom factor must be a power of two
+    int zoom = settings->zoom;
+    if (zoom < 1 || (zoom & (zoom - 1)) != 0)
+    {
+        fprintf(stderr, "Zoom factor must be a power of two\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // The latency target is met by sizing the autocorrelator's launches, and
+    // cross-correlation always launches a single loop
+    if (settings->latency_target > 0 && settings->input2_file != NULL)
+    {
+        fprintf(stderr, "--latency-target cannot be used with --input2\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Given an integration time, the batch size, super-batch and number of
+    // loops are planned once the devices are known, and the remaining
+    // settings are derived after that. The planned super-batch then limits
+    // the launches sized for any latency target
+    if (settings->integration > 0)
+    {
+        if (settings->bins == 0 || settings->rate <= 0 ||
+            settings->spc != 0 || settings->batch_size != 0)
+        {
+            fprintf(stderr, "--integration requires -n and --rate, and "
+                "replaces -a and -b\n");
+            exit(EXIT_FAILURE);
+        }
+
+        if (settings->loops != 0 || settings->length != 0 ||
+            settings->superbatch != 1)
+        {
+            fprintf(stderr, "--integration replaces --loops, --length and "
+                "--superbatch\n");
+            exit(EXIT_FAILURE);
+        }
+
+        return;
+    }
+    else if (settings->latency > 0)
+    {
+        fprintf(stderr, "--latency requires --integration\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Otherwise the launches sized for a latency target are limited by the
+    // automatic super-batch, unless one is given
+    if (settings->latency_target > 0 && settings->superbatch == 1)
+    {
+        settings->superbatch = 0;
+    }
+
+    options_derive(settings);
+}
+
+/*
+ * Derives the settings which follow from the samples per channel, batch size
+ * and bins, checking that they are consistent with each other and with the
+ * other options.
+ */
+void options_derive(ga_settings *settings)
+{
+    int zoom = settings->zoom;
+
+    // Ensure spc, batch_size and bins are all specified, where each FFT covers
+    // zoom times as many input samples when zoomed
     if (settings->spc != 0 && settings->batch_size != 0 && settings->bins != 0)
     {
         // If all three are specified, but incorrectly
-        if (settings->spc != (settings->bins)*(settings->batch_size))
+        if (settings->spc != (settings->bins)*(settings->batch_size)*zoom)
         {
-            fprintf(stderr, "Samples per channel != bins * batch size\n");
+            fprintf(stderr, "Samples per channel != bins * batch size * "
+                "zoom\n");
             exit(EXIT_FAILURE);
         }
     }
     else if (settings->spc == 0)
     {
         // Determine the number of samples per channel
-        settings->spc = (settings->bins)*(settings->batch_size);
+        settings->spc = (settings->bins)*(settings->batch_size)*zoom;
     }
     else if (settings->batch_size == 0)
     {
         // Determine the batch size
-        settings->batch_size = (settings->spc)/(settings->bins);
+        settings->batch_size = (settings->spc)/(settings->bins)/zoom;
     }
     else if (settings->bins == 0)
     {
         // Determine the number of FFT bins
-        settings->bins = (settings->spc)/(settings->batch_size);
+        settings->bins = (settings->spc)/(settings->batch_size)/zoom;
     }
 
     // If one or more is still equal to zero
@@ -219,4 +628,314 @@ void options(int argc, char *argv[], ga_settings *settings)
     settings->n = (settings->spc)*(settings->channels);
     settings->bytes = (settings->n)*(settings->bps)/8;
     settings->output_length = (settings->bins)/2*(settings->channels);
+
+    // Packed mode stores pairs of real channels as one complex channel
+    if (settings->packed && settings->channels % 2 != 0)
+    {
+        fprintf(stderr, "Packed mode requires an even number of channels\n");
+        exit(EXIT_FAILURE);
+    }
+    settings->data_length = settings->packed ? (settings->n)/2 : settings->n;
+
+    if (settings->zoom > 1)
+    {
+        // Zoom mode is applied in place of the convert kernels, and its
+        // output is complex, so every bin of each channel is kept
+        if (settings->packed || settings->waterfall_file != NULL ||
+            settings->input2_file != NULL)
+        {
+            fprintf(stderr, "Zoom mode cannot be combined with --packed, "
+                "--waterfall or --input2\n");
+            exit(EXIT_FAILURE);
+        }
+
+        settings->data_length = (settings->n)/(settings->zoom);
+        settings->output_length = (settings->bins)*(settings->channels);
+
+        // The band centre defaults to the middle of the channel, and may be
+        // given once for every channel or once per channel
+        settings->zoom_centre = malloc(settings->channels*sizeof(float));
+        int n_bands = 0;
+
+        if (settings->zoom_bands != NULL)
+        {
+            for (char *tok = strtok(settings->zoom_bands, ","); tok != NULL;
+                tok = strtok(NULL, ","))
+            {
+                if (n_bands == settings->channels)
+                {
+                    n_bands++;
+                    break;
+                }
+                settings->zoom_centre[n_bands++] = atof(tok);
+            }
+        }
+
+        if (n_bands != 0 && n_bands != 1 && n_bands != settings->channels)
+        {
+            fprintf(stderr, "Give one zoom band centre, or one per channel\n");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int c = 0; c < settings->channels; c++)
+        {
+            if (n_bands == 0)
+            {
+                settings->zoom_centre[c] = 0.25;
+            }
+            else if (n_bands == 1)
+            {
+                settings->zoom_centre[c] = settings->zoom_centre[0];
+            }
+
+            // The whole zoom band must lie within the channel
+            float half = 0.5/settings->zoom;
+            if (settings->zoom_centre[c] - half < 0 ||
+                settings->zoom_centre[c] + half > 0.5)
+            {
+                fprintf(stderr, "Zoom band centres must lie between %g and "
+                    "%g cycles per sample\n", half, 0.5 - half);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // The filter is eight taps per decimated sample long, and is run on
+        // from the samples preceding each launch
+        settings->zoom_taps = 8*settings->zoom;
+        settings->history = settings->zoom_taps*(settings->channels)*
+            (settings->bps)/8;
+
+        if (settings->history > settings->bytes)
+        {
+            fprintf(stderr, "Zoom filter is longer than one loop\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (settings->zoom_bands != NULL)
+    {
+        fprintf(stderr, "--zoom-band requires --zoom\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // By default the waterfall has one row per loop
+    if (settings->decimate == 0)
+    {
+        settings->decimate = settings->batch_size;
+    }
+
+    if (settings->decimate < 1 ||
+        settings->batch_size % settings->decimate != 0)
+    {
+        fprintf(stderr, "Waterfall decimation must divide the batch size\n");
+        exit(EXIT_FAILURE);
+    }
+    settings->waterfall_rows = (settings->batch_size)/(settings->decimate);
+
+    // Cross-correlation produces both autocorrelations and the cross spectrum
+    settings->spectra = 1;
+
+    if (settings->input2_file != NULL)
+    {
+        // Each loop depends on the history of the previous loop
+        if (settings->superbatch != 1 || settings->packed ||
+            settings->waterfall_file != NULL || settings->partial_file != NULL)
+        {
+            fprintf(stderr, "Cross-correlation cannot be combined with "
+                "--superbatch, --packed, --waterfall or --partial\n");
+            exit(EXIT_FAILURE);
+        }
+        settings->spectra = 3;
+    }
+
+    // Only the waterfall is written often enough to be worth compressing
+    if (settings->compress_threads < 0 ||
+        (settings->compress_threads > 0 && settings->waterfall_file == NULL))
+    {
+        fprintf(stderr, "--compress requires --waterfall and a number of "
+            "threads\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Each additional resolution is summed from the same converted data, so
+    // its FFTs must divide each channel of a loop
+    if (settings->n_resolutions > 0)
+    {
+        if (settings->input2_file != NULL || settings->partial_file != NULL)
+        {
+            fprintf(stderr, "Additional resolutions cannot be combined with "
+                "--input2 or --partial\n");
+            exit(EXIT_FAILURE);
+        }
+
+        settings->resolution_lengths = malloc(settings->n_resolutions*
+            sizeof(int));
+        settings->resolutions_length = 0;
+
+        for (int r = 0; r < settings->n_resolutions; r++)
+        {
+            int bins = settings->resolutions[r];
+
+            if (bins < 2 || (settings->spc/zoom) % bins != 0)
+            {
+                fprintf(stderr, "Resolution of %d bins must divide the %d "
+                    "samples per channel\n", bins, settings->spc/zoom);
+                exit(EXIT_FAILURE);
+            }
+
+            settings->resolution_lengths[r] = (zoom > 1 ? bins : bins/2)*
+                (settings->channels);
+            settings->resolutions_length += settings->resolution_lengths[r];
+        }
+    }
+
+    // Folding needs the sample rate to turn the ephemeris into phases
+    if (settings->fold_file != NULL)
+    {
+        if (settings->rate <= 0 || settings->n_ephemeris == 0 ||
+            settings->phase_bins < 1)
+        {
+            fprintf(stderr, "--fold requires --rate, --ephemeris and at least "
+                "one phase bin\n");
+            exit(EXIT_FAILURE);
+        }
+
+        if (settings->zoom > 1 || settings->input2_file != NULL)
+        {
+            fprintf(stderr, "Folding cannot be combined with --zoom or "
+                "--input2\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (settings->n_ephemeris > 0)
+    {
+        fprintf(stderr, "--ephemeris requires --fold\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Dedispersion needs the time of each waterfall row and the frequency of
+    // each bin
+    if (settings->trigger_file != NULL)
+    {
+        if (settings->rate <= 0 || settings->n_dm == 0 ||
+            settings->channel_width <= 0)
+        {
+            fprintf(stderr, "--triggers requires --rate, --dm and --freq\n");
+            exit(EXIT_FAILURE);
+        }
+
+        if (settings->zoom > 1 || settings->input2_file != NULL)
+        {
+            fprintf(stderr, "Dedispersion cannot be combined with --zoom or "
+                "--input2\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Each selected range is given as first:last[:average] in the bins of a
+    // channel, and is applied to every channel
+    settings->dump_length = settings->output_length;
+    int row_length = (settings->output_length)/(settings->channels);
+
+    for (char *tok = settings->select_ranges == NULL ? NULL :
+        strtok(settings->select_ranges, ","); tok != NULL;
+        tok = strtok(NULL, ","))
+    {
+        int first, last, average = 1;
+
+        if (sscanf(tok, "%d:%d:%d", &first, &last, &average) < 2 ||
+            first < 0 || last < first || last >= row_length || average < 1 ||
+            (last - first + 1) % average != 0)
+        {
+            fprintf(stderr, "Invalid bin range: %s (bins run from 0 to %d, "
+                "and the average must divide the range)\n", tok,
+                row_length - 1);
+            exit(EXIT_FAILURE);
+        }
+
+        for (int b = first; b <= last; b += average)
+        {
+            settings->select_map = realloc(settings->select_map,
+                2*(settings->select_length + 1)*sizeof(int));
+            settings->select_map[2*settings->select_length] = b;
+            settings->select_map[2*settings->select_length + 1] = average;
+            settings->select_length++;
+        }
+    }
+
+    if (settings->select_length > 0)
+    {
+        settings->dump_length = settings->select_length*(settings->channels);
+    }
+
+    // The offset and length must both fall on loop boundaries
+    if (settings->offset < 0 || settings->offset % settings->bytes != 0)
+    {
+        fprintf(stderr, "Offset must be a multiple of %d bytes (one loop)\n",
+            settings->bytes);
+        exit(EXIT_FAILURE);
+    }
+
+    if (settings->length < 0 || settings->length % settings->bytes != 0)
+    {
+        fprintf(stderr, "Length must be a multiple of %d bytes (one loop)\n",
+            settings->bytes);
+        exit(EXIT_FAILURE);
+    }
+
+    // Convert the length into a number of loops
+    if (settings->length != 0)
+    {
+        if (settings->loops != 0)
+        {
+            fprintf(stderr, "Only one of --length and --loops may be "
+                "specified\n");
+            exit(EXIT_FAILURE);
+        }
+        settings->loops = (settings->length)/(settings->bytes);
+    }
+
+    // The synthetic input never ends, and only feeds the autocorrelator
+    if (settings->input_type == INPUT_SYNTH)
+    {
+        if (settings->loops == 0)
+        {
+            fprintf(stderr, "Synthetic input requires --loops or --length\n");
+            exit(EXIT_FAILURE);
+        }
+
+        if (settings->input2_file != NULL)
+        {
+            fprintf(stderr, "Synthetic input cannot be cross-correlated\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // The recording is written from the autocorrelator's input buffers
+    if (settings->record_file != NULL &&
+        (settings->input_type == INPUT_SYNTH || settings->input2_file != NULL))
+    {
+        fprintf(stderr, "--record cannot be used with synthetic input or "
+            "--input2\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < settings->n_tones; i++)
+    {
+        float *tone = settings->tones + 4*i;
+
+        if (tone[0] < 0 || tone[0] >= settings->channels || tone[1] < 0 ||
+            tone[1] >= settings->bins/2 || tone[0] != (int)tone[0] ||
+            tone[1] != (int)tone[1])
+        {
+            fprintf(stderr, "Tones must lie on a bin below %d of a channel "
+                "below %d\n", settings->bins/2, settings->channels);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (settings->noise < 0)
+    {
+        fprintf(stderr, "Noise must not be negative\n");
+        exit(EXIT_FAILURE);
+    }
 }
@@ -1 +1,2 @@
 void options(int argc, char *argv[], ga_settings *settings);
+void options_derive(ga_settings *settings);
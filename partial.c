@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "partial.h"
+
+/*
+ * Writes an accumulated spectrum along with the information required to merge
+ * it with the spectra from other time ranges of the same recording. The
+ * spectrum holds output_length complex values stored as pairs of floats.
+ */
+void partial_write(char *filename, partial_header *header, float *spectrum)
+{
+    FILE    *fp;
+    int     version = PARTIAL_VERSION;
+
+    // Open the file
+    fp = fopen(filename, "wb");
+
+    // Check the return value
+    if (fp == NULL)
+    {
+        fprintf(stderr, "%s: ", filename);
+        perror("");
+        exit(EXIT_FAILURE);
+    }
+
+    // Write the magic number, version, header and spectrum
+    fwrite(PARTIAL_MAGIC, 1, strlen(PARTIAL_MAGIC), fp);
+    fwrite(&version, sizeof(version), 1, fp);
+    fwrite(header, sizeof(partial_header), 1, fp);
+    fwrite(spectrum, 2*sizeof(float), header->output_length, fp);
+
+    if (ferror(fp) || fclose(fp) != 0)
+    {
+        fprintf(stderr, "%s: Unable to write partial spectrum\n", filename);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Reads a partial spectrum written by partial_write. The header is filled in
+ * and the spectrum is returned in newly allocated memory.
+ */
+float *partial_read(char *filename, partial_header *header)
+{
+    FILE    *fp;
+    char    magic[sizeof(PARTIAL_MAGIC)] = {0};
+    int     version;
+    float   *spectrum;
+
+    // Open the file
+    fp = fopen(filename, "rb");
+
+    // Check the return value
+    if (fp == NULL)
+    {
+        fprintf(stderr, "%s: ", filename);
+        perror("");
+        exit(EXIT_FAILURE);
+    }
+
+    // Check the magic number and version
+    if (fread(magic, 1, strlen(PARTIAL_MAGIC), fp) != strlen(PARTIAL_MAGIC) ||
+        strcmp(magic, PARTIAL_MAGIC) != 0)
+    {
+        fprintf(stderr, "%s: Not a partial spectrum\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    if (fread(&version, sizeof(version), 1, fp) != 1 ||
+        version != PARTIAL_VERSION)
+    {
+        fprintf(stderr, "%s: Unsupported partial spectrum version\n",
+            filename);
+        exit(EXIT_FAILURE);
+    }
+
+    // Read the header and the spectrum
+    if (fread(header, sizeof(partial_header), 1, fp) != 1)
+    {
+        fprintf(stderr, "%s: Truncated header\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    spectrum = malloc(header->output_length*2*sizeof(float));
+    if (fread(spectrum, 2*sizeof(float), header->output_length, fp) !=
+        header->output_length)
+    {
+        fprintf(stderr, "%s: Truncated spectrum\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    fclose(fp);
+
+    return spectrum;
+}
@@ -0,0 +1,16 @@
+#define PARTIAL_MAGIC   "CLAUTOPS"
+#define PARTIAL_VERSION 1
+
+typedef struct
+{
+    int         bins;           // Number of FFT bins
+    int         channels;       // Number of channels
+    int         spc;            // Samples per channel per loop
+    int         bytes;          // Bytes of input per loop
+    int         output_length;  // Number of complex values in the spectrum
+    long long   loops;          // Number of loops integrated
+    long long   offset;         // Byte offset of the first loop in the input
+} partial_header;
+
+void partial_write(char *filename, partial_header *header, float *spectrum);
+float *partial_read(char *filename, partial_header *header);
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <CL/opencl.h>
+
+#include "main.h"
+#include "cl_abstractions.h"
+#include "cl_error.h"
+#include "scheduler.h"
+#include "plan.h"
+
+// Each worker should get at least this many loops of the integration, so the
+// scheduler can balance the work between devices
+#define PLAN_LOOPS_PER_WORKER 4
+
+// Device memory used by the buffers of one worker
+typedef struct
+{
+    cl_ulong    input;          // Input buffer, including the history
+    cl_ulong    data;           // Data buffer
+    cl_ulong    waterfall;      // Waterfall buffer
+    cl_ulong    spectra;        // Spectrum and output buffers
+    cl_ulong    resolutions;    // Buffers of the additional resolutions
+} plan_buffers;
+
+/*
+ * Retrieves the total memory of a device and the largest buffer it allows.
+ */
+void plan_device_memory(cl_vars *cl, cl_ulong *global_mem,
+    cl_ulong *max_alloc)
+{
+    cl_int      err_ret;
+
+    err_ret = clGetDeviceInfo(cl->device, CL_DEVICE_GLOBAL_MEM_SIZE,
+        sizeof(*global_mem), global_mem, NULL);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clGetDeviceInfo(cl->device, CL_DEVICE_MAX_MEM_ALLOC_SIZE,
+        sizeof(*max_alloc), max_alloc, NULL);
+    check_error(__FILE__, __LINE__, err_ret);
+}
+
+/*
+ * Works out the size of each of a worker's device buffers for a batch size
+ * and super-batch. Only the options given on the command line are used, so
+ * that candidate batch sizes can be sized before the settings derived from
+ * the batch size are filled in. The sizes follow those in options and main.
+ */
+void plan_sizes(ga_settings *settings, int batch_size, int superbatch,
+    plan_buffers *b)
+{
+    // Samples are always 2-bit for now, as in options
+    cl_ulong spc = (cl_ulong)settings->bins*batch_size*settings->zoom;
+    cl_ulong n = spc*settings->channels;
+    cl_ulong bytes = n*2/8;
+    cl_ulong data_length = settings->packed ? n/2 : n/settings->zoom;
+    cl_ulong output_length = (settings->zoom > 1 ? settings->bins :
+        settings->bins/2)*settings->channels;
+
+    // Selected bins are compacted into a buffer of their own
+    cl_ulong dump_length = settings->select_length > 0 ?
+        settings->dump_length : 0;
+
+    if (settings->input2_file != NULL)
+    {
+        // Cross-correlation has two inputs, each holding two loops, and
+        // three spectra
+        b->input = 2*2*bytes;
+        b->data = 2*data_length*sizeof(cl_float2);
+        b->waterfall = 0;
+        b->spectra = (3*2*output_length + dump_length)*sizeof(cl_float2);
+        b->resolutions = 0;
+        return;
+    }
+
+    // Zoom mode transfers the samples preceding each launch with it
+    cl_ulong history = settings->zoom > 1 ?
+        8*settings->zoom*settings->channels*2/8 : 0;
+
+    b->input = history + superbatch*bytes;
+    b->data = superbatch*data_length*sizeof(cl_float2);
+    b->waterfall = 0;
+    b->resolutions = 0;
+    b->spectra = (2*output_length + dump_length)*sizeof(cl_float2);
+
+    // Additional resolutions are transformed into a buffer of their own, and
+    // summed into a spectrum each
+    if (settings->n_resolutions > 0)
+    {
+        b->resolutions = b->data;
+
+        for (int r = 0; r < settings->n_resolutions; r++)
+        {
+            int bins = settings->resolutions[r];
+            b->resolutions += (cl_ulong)(settings->zoom > 1 ? bins : bins/2)*
+                settings->channels*sizeof(cl_float2);
+        }
+    }
+
+    // The folded spectra and their frame counts stay on the device
+    if (settings->fold_file != NULL)
+    {
+        b->spectra += (cl_ulong)settings->phase_bins*
+            (output_length*sizeof(float) + sizeof(int));
+    }
+
+    if (settings->waterfall_file != NULL || settings->trigger_file != NULL)
+    {
+        int rows = settings->decimate == 0 ? 1 :
+            batch_size/settings->decimate;
+        b->waterfall = (cl_ulong)superbatch*rows*output_length*sizeof(float);
+    }
+}
+
+/*
+ * Returns the device memory a worker needs for a batch size and super-batch,
+ * and the size of its largest buffer in largest.
+ */
+cl_ulong plan_memory(ga_settings *settings, int batch_size, int superbatch,
+    cl_ulong *largest)
+{
+    plan_buffers b;
+
+    plan_sizes(settings, batch_size, superbatch, &b);
+
+    *largest = b.input;
+    if (b.data > *largest)
+    {
+        *largest = b.data;
+    }
+    if (b.waterfall > *largest)
+    {
+        *largest = b.waterfall;
+    }
+
+    return b.input + b.data + b.waterfall + b.spectra + b.resolutions;
+}
+
+/*
+ * Chooses the batch size, super-batch and number of loops from the bins, the
+ * sample rate, the integration time and the optional latency budget. The
+ * plan which puts the most samples through each launch, up to the point where
+ * launches stop getting more efficient, is chosen, preferring larger batches
+ * to larger super-batches. A plan must fit in half of the smallest device's
+ * memory, like an automatic super-batch, and the data for a whole launch
+ * must arrive within the latency budget.
+ */
+void plan_batch(ga_settings *settings, cl_ulong global_mem,
+    cl_ulong max_alloc, int n_workers)
+{
+    double      samples = settings->integration*settings->rate;
+    double      budget = samples;
+    int         best_batch = 0;
+    int         best_superbatch = 0;
+    cl_ulong    best_launch = 0;
+    cl_ulong    largest;
+
+    if (settings->latency > 0 && settings->latency*settings->rate < budget)
+    {
+        budget = settings->latency*settings->rate;
+    }
+
+    for (int batch = 1; batch <= (1 << 24); batch *= 2)
+    {
+        double spc = (double)settings->bins*batch*settings->zoom;
+
+        // Stop once a single loop is too long or too large
+        if (spc > budget || n_workers*PLAN_LOOPS_PER_WORKER*spc > samples ||
+            plan_memory(settings, batch, 1, &largest) > global_mem/2 ||
+            largest > max_alloc)
+        {
+            break;
+        }
+
+        // Grow the super-batch as the automatic super-batch would, while
+        // keeping within the latency budget and the loops of each worker
+        cl_ulong data_length = (cl_ulong)spc*settings->channels/
+            (settings->packed ? 2 : settings->zoom);
+        int k = 1;
+
+        while (settings->input2_file == NULL && k < SUPERBATCH_MAX &&
+            k*data_length < SUPERBATCH_SAMPLES && 2*k*spc <= budget &&
+            n_workers*PLAN_LOOPS_PER_WORKER*2*k*spc <= samples &&
+            plan_memory(settings, batch, 2*k, &largest) <= global_mem/2 &&
+            largest <= max_alloc)
+        {
+            k *= 2;
+        }
+
+        cl_ulong launch = MIN(k*data_length, SUPERBATCH_SAMPLES);
+        if (launch >= best_launch)
+        {
+            best_batch = batch;
+            best_superbatch = k;
+            best_launch = launch;
+        }
+    }
+
+    if (best_batch == 0)
+    {
+        fprintf(stderr, "No batch size of %d bins fits the integration time, "
+            "latency and device memory\n", settings->bins);
+        exit(EXIT_FAILURE);
+    }
+
+    settings->batch_size = best_batch;
+    settings->superbatch = best_superbatch;
+
+    double spc = (double)settings->bins*best_batch*settings->zoom;
+    settings->loops = (int)MAX(1, llround(samples/spc));
+
+    fprintf(stderr, "Plan: batch size %d, super-batch %d, %d loops of %.6lf "
+        "s (%.6lf s integration, %.6lf s per launch)\n", best_batch,
+        best_superbatch, settings->loops, spc/settings->rate,
+        settings->loops*spc/settings->rate,
+        best_superbatch*spc/settings->rate);
+}
+
+/*
+ * Prints the device memory a worker will use and exits if it does not fit,
+ * before any buffer is created.
+ */
+void plan_footprint(ga_settings *settings, cl_vars *cl, int superbatch)
+{
+    plan_buffers    b;
+    cl_ulong        global_mem;
+    cl_ulong        max_alloc;
+    cl_ulong        largest;
+
+    plan_device_memory(cl, &global_mem, &max_alloc);
+    plan_sizes(settings, settings->batch_size, superbatch, &b);
+    cl_ulong total = plan_memory(settings, settings->batch_size, superbatch,
+        &largest);
+
+    fprintf(stderr, "[Device %d] Memory: input %.1lf MiB, data %.1lf MiB, "
+        "waterfall %.1lf MiB, spectra %.1lf MiB, resolutions %.1lf MiB, "
+        "total %.1lf of %.1lf MiB\n", cl->device_id, b.input/1048576.0,
+        b.data/1048576.0, b.waterfall/1048576.0, b.spectra/1048576.0,
+        b.resolutions/1048576.0, total/1048576.0, global_mem/1048576.0);
+
+    if (total > global_mem || largest > max_alloc)
+    {
+        fprintf(stderr, "[Device %d] Buffers do not fit in device memory "
+            "(largest buffer %.1lf MiB, limit %.1lf MiB)\n", cl->device_id,
+            largest/1048576.0, max_alloc/1048576.0);
+        exit(EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,7 @@
+void plan_device_memory(cl_vars *cl, cl_ulong *global_mem,
+    cl_ulong *max_alloc);
+cl_ulong plan_memory(ga_settings *settings, int batch_size, int superbatch,
+    cl_ulong *largest);
+void plan_batch(ga_settings *settings, cl_ulong global_mem,
+    cl_ulong max_alloc, int n_workers);
+void plan_footprint(ga_settings *settings, cl_vars *cl, int superbatch);
@@ -0,0 +1,345 @@
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <CL/opencl.h>
+
+#include "main.h"
+#include "metrics.h"
+#include "numa.h"
+#include "trace.h"
+#include "record.h"
+
+// Alignment of the buffers, offsets and sizes written with O_DIRECT
+#define RECORD_ALIGN    4096
+
+typedef struct
+{
+    unsigned int    *buffers[RECORD_BUFFERS];   // Input buffers of a worker
+    int             busy[RECORD_BUFFERS];       // Buffers being written
+} record_slot;
+
+typedef struct
+{
+    int         worker;         // Worker the buffer belongs to
+    int         buffer;         // Index of the buffer in its slot
+    long long   loop;           // First loop in the buffer
+    int         count;          // Number of loops in the buffer
+} record_job;
+
+// Input buffers of each worker, and the queue of those waiting to be written
+record_slot     *record_slots;
+record_job      *record_queue;
+int             record_capacity;
+int             record_head;
+int             record_count;
+int             record_done;
+pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  record_not_empty = PTHREAD_COND_INITIALIZER;
+pthread_cond_t  record_written = PTHREAD_COND_INITIALIZER;
+pthread_t       record_thread_id;
+
+char            *record_filename;
+int             record_fd = -1;
+int             record_direct;
+int             record_failed;
+size_t          record_history;
+size_t          record_bytes;
+
+// Totals for the report
+long long       record_loops;
+long long       record_dropped;
+double          record_write_us;
+struct timeval  record_t_start;
+
+/*
+ * Writes each queued buffer to its loops' place in the file, straight from
+ * the memory the worker transferred to the device, then hands the buffer
+ * back to the worker.
+ */
+void *record_thread(void *arg)
+{
+    trace_thread("Recorder", -1);
+
+    for (;;)
+    {
+        pthread_mutex_lock(&record_lock);
+
+        while (record_count == 0 && !record_done)
+        {
+            pthread_cond_wait(&record_not_empty, &record_lock);
+        }
+
+        if (record_count == 0)
+        {
+            pthread_mutex_unlock(&record_lock);
+            break;
+        }
+
+        record_job job = record_queue[record_head];
+        record_head = (record_head + 1) % record_capacity;
+        record_count--;
+        int failed = record_failed;
+        pthread_mutex_unlock(&record_lock);
+
+        // Skip the history which precedes the loops in the buffer
+        char *data = (char *)record_slots[job.worker].buffers[job.buffer] +
+            record_history;
+        size_t n_bytes = (size_t)job.count*record_bytes;
+        off_t offset = (off_t)job.loop*record_bytes;
+        double t_write = trace_now();
+
+        while (!failed && n_bytes > 0)
+        {
+            ssize_t written = pwrite(record_fd, data, n_bytes, offset);
+
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            // Give up on the recording, but never on the processing
+            if (written <= 0)
+            {
+                fprintf(stderr, "%s: %s, recording stopped\n",
+                    record_filename,
+                    written < 0 ? strerror(errno) : "Short write");
+                failed = 1;
+                break;
+            }
+
+            data += written;
+            n_bytes -= written;
+            offset += written;
+        }
+
+        trace_span("record", t_write);
+
+        pthread_mutex_lock(&record_lock);
+
+        if (failed)
+        {
+            record_failed = 1;
+            record_dropped += job.count;
+            metrics_add(METRIC_RECORD_DROPS, job.count);
+        }
+        else
+        {
+            record_loops += job.count;
+            record_write_us += trace_now() - t_write;
+            metrics_add(METRIC_RECORD_BYTES, (long long)job.count*
+                record_bytes);
+        }
+
+        record_slots[job.worker].busy[job.buffer] = 0;
+        pthread_cond_broadcast(&record_written);
+        pthread_mutex_unlock(&record_lock);
+    }
+
+    return NULL;
+}
+
+/*
+ * Creates the recording and starts the thread which writes it. The file is
+ * written with O_DIRECT when the loops and history keep every write aligned
+ * and the filesystem supports it, so the input is never copied through the
+ * page cache.
+ */
+void record_open(ga_settings *settings, int n_workers)
+{
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+    record_filename = settings->record_file;
+    record_history = settings->history;
+    record_bytes = settings->bytes;
+    record_direct = record_history%RECORD_ALIGN == 0 &&
+        record_bytes%RECORD_ALIGN == 0;
+
+    record_fd = -1;
+    if (record_direct)
+    {
+        record_fd = open(record_filename, flags | O_DIRECT, 0644);
+    }
+
+    if (record_fd < 0)
+    {
+        record_direct = 0;
+        record_fd = open(record_filename, flags, 0644);
+    }
+
+    if (record_fd < 0)
+    {
+        fprintf(stderr, "%s: ", record_filename);
+        perror("");
+        exit(EXIT_FAILURE);
+    }
+
+    record_slots = calloc(n_workers, sizeof(record_slot));
+    record_capacity = n_workers*RECORD_BUFFERS;
+    record_queue = malloc(record_capacity*sizeof(record_job));
+    record_head = 0;
+    record_count = 0;
+    record_done = 0;
+    record_failed = 0;
+    record_loops = 0;
+    record_dropped = 0;
+    record_write_us = 0;
+    gettimeofday(&record_t_start, NULL);
+
+    pthread_create(&record_thread_id, NULL, record_thread, NULL);
+}
+
+/*
+ * Gives the recorder a worker's input buffer of n_bytes, and allocates the
+ * spare buffers the worker fills while another is being written. The buffers
+ * must have been allocated with numa_alloc, so are aligned for O_DIRECT.
+ */
+void record_attach(int worker, unsigned int *buffer, size_t n_bytes,
+    int node)
+{
+    record_slot *slot = &record_slots[worker];
+
+    slot->buffers[0] = buffer;
+
+    for (int i = 1; i < RECORD_BUFFERS; i++)
+    {
+        slot->buffers[i] = numa_alloc(n_bytes, node);
+    }
+}
+
+/*
+ * Queues the buffer a worker has just transferred to the device to be
+ * written, and returns a free buffer for the worker to fill next. If the
+ * disk has fallen behind and none are free, the loops are not recorded and
+ * the same buffer is returned, so the worker is never held up.
+ */
+unsigned int *record_swap(int worker, unsigned int *buffer, long long loop,
+    int count)
+{
+    record_slot     *slot = &record_slots[worker];
+    unsigned int    *next = buffer;
+    int             current = 0;
+    int             spare = -1;
+
+    pthread_mutex_lock(&record_lock);
+
+    for (int i = 0; i < RECORD_BUFFERS; i++)
+    {
+        if (slot->buffers[i] == buffer)
+        {
+            current = i;
+        }
+        else if (!slot->busy[i] && spare < 0)
+        {
+            spare = i;
+        }
+    }
+
+    if (spare >= 0 && !record_failed)
+    {
+        record_job *job = &record_queue[(record_head + record_count)%
+            record_capacity];
+        job->worker = worker;
+        job->buffer = current;
+        job->loop = loop;
+        job->count = count;
+        record_count++;
+
+        slot->busy[current] = 1;
+        next = slot->buffers[spare];
+        pthread_cond_signal(&record_not_empty);
+    }
+    else
+    {
+        record_dropped += count;
+        metrics_add(METRIC_RECORD_DROPS, count);
+    }
+
+    pthread_mutex_unlock(&record_lock);
+
+    // The scheduler copies the history into whichever buffer it is given
+    return next;
+}
+
+/*
+ * Waits for a worker's buffers to be written, then frees them all, including
+ * the one it attached.
+ */
+void record_detach(int worker)
+{
+    record_slot *slot = &record_slots[worker];
+
+    pthread_mutex_lock(&record_lock);
+
+    for (int i = 0; i < RECORD_BUFFERS; i++)
+    {
+        while (slot->busy[i])
+        {
+            pthread_cond_wait(&record_written, &record_lock);
+        }
+    }
+
+    pthread_mutex_unlock(&record_lock);
+
+    for (int i = 0; i < RECORD_BUFFERS; i++)
+    {
+        free(slot->buffers[i]);
+    }
+}
+
+/*
+ * Finishes the recording, and reports whether the disk kept up with the
+ * input.
+ */
+void record_close(void)
+{
+    struct timeval t_end;
+
+    if (record_fd < 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&record_lock);
+    record_done = 1;
+    pthread_cond_broadcast(&record_not_empty);
+    pthread_mutex_unlock(&record_lock);
+
+    pthread_join(record_thread_id, NULL);
+
+    if (close(record_fd) != 0)
+    {
+        fprintf(stderr, "%s: ", record_filename);
+        perror("");
+    }
+    record_fd = -1;
+
+    gettimeofday(&t_end, NULL);
+    double elapsed = (t_end.tv_sec - record_t_start.tv_sec) +
+        (t_end.tv_usec - record_t_start.tv_usec)/1e6;
+    double written = (double)record_loops*record_bytes;
+
+    fprintf(stderr, "Recorded %lld of %lld loops (%.1lf MiB%s), writing at "
+        "%.1lf MB/s and busy for %.0lf%% of the run\n", record_loops,
+        record_loops + record_dropped, written/1048576.0,
+        record_direct ? ", O_DIRECT" : "",
+        record_write_us > 0 ? written/record_write_us : 0,
+        elapsed > 0 ? 100*record_write_us/1e6/elapsed : 0);
+
+    if (record_dropped > 0)
+    {
+        fprintf(stderr, "Warning: the disk did not keep up with the input, "
+            "%lld loops are missing from %s\n",
+            record_dropped, record_filename);
+    }
+
+    free(record_slots);
+    free(record_queue);
+}
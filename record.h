@@ -0,0 +1,11 @@
+// Input buffers each worker cycles through while recording, so that one can
+// be filled while the others are written
+#define RECORD_BUFFERS  3
+
+void record_open(ga_settings *settings, int n_workers);
+void record_attach(int worker, unsigned int *buffer, size_t n_bytes,
+    int node);
+unsigned int *record_swap(int worker, unsigned int *buffer, long long loop,
+    int count);
+void record_detach(int worker);
+void record_close(void);
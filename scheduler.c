@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <CL/opencl.h>
+
+#include "main.h"
+#include "cl_abstractions.h"
+#include "cl_error.h"
+#include "data_handling.h"
+#include "scheduler.h"
+#include "metrics.h"
+#include "trace.h"
+#include "plan.h"
+
+// Weight given to the most recent loop time in each worker's average
+#define LOOP_TIME_WEIGHT 0.2
+
+pthread_mutex_t scheduler_lock = PTHREAD_MUTEX_INITIALIZER;
+int             scheduler_workers;
+long long       scheduler_next;
+int             scheduler_eof;
+double          *scheduler_loop_time;
+char            *scheduler_history;
+
+/*
+ * Sets up the shared work queue. Each work item is one loop of input, handed
+ * out in order to whichever worker asks for it next.
+ */
+void scheduler_initialise(ga_settings *settings, int n_workers)
+{
+    scheduler_workers = n_workers;
+    scheduler_next = 0;
+    scheduler_eof = 0;
+    scheduler_loop_time = calloc(n_workers, sizeof(double));
+
+    // The input before the start of the stream is taken as zeros
+    scheduler_history = calloc(settings->history + 1, 1);
+}
+
+/*
+ * Claims up to max_loops consecutive loops for a worker and reads their input
+ * into h_data, after the settings->history bytes which precede them in the
+ * input. Returns the number of loops claimed, which is 0 when there is
+ * no more work for this worker, either because the input or loop limit has
+ * been reached, or because the final loops would be finished sooner by a
+ * faster device. If arrival is not NULL, the time each loop's input arrived
+ * is stored in it.
+ */
+int scheduler_claim(ga_settings *settings, int worker, unsigned int *h_data,
+    int max_loops, long long *loop, double *arrival)
+{
+    int claimed = 0;
+
+    pthread_mutex_lock(&scheduler_lock);
+
+    if (!scheduler_eof &&
+        (settings->loops == 0 || scheduler_next < settings->loops))
+    {
+        claimed = max_loops;
+
+        if (settings->loops != 0)
+        {
+            claimed = MIN(claimed, settings->loops - scheduler_next);
+        }
+
+        // Near the end of a fixed number of loops, leave the remaining work
+        // to the fastest device if this one would take more than twice as
+        // long, as it would otherwise finish last
+        if (settings->loops != 0 &&
+            settings->loops - scheduler_next < scheduler_workers*max_loops)
+        {
+            double fastest = scheduler_loop_time[worker];
+            for (int i = 0; i < scheduler_workers; i++)
+            {
+                if (scheduler_loop_time[i] > 0 &&
+                    scheduler_loop_time[i] < fastest)
+                {
+                    fastest = scheduler_loop_time[i];
+                }
+            }
+
+            if (scheduler_loop_time[worker] > 2*fastest)
+            {
+                claimed = 0;
+            }
+        }
+    }
+
+    // Synthetic input is generated on the device, so there is nothing to read
+    // and every loop arrives as it is claimed
+    for (int k = 0; k < claimed && arrival != NULL &&
+        settings->input_type == INPUT_SYNTH; k++)
+    {
+        arrival[k] = trace_now();
+    }
+
+    char *loops_data = (char *)h_data + settings->history;
+
+    for (int k = 0; k < claimed && settings->input_type != INPUT_SYNTH; k++)
+    {
+        // Read in the data for each loop
+        char *dest = loops_data + (size_t)k*settings->bytes;
+        double t_read = trace_now();
+        int r_bytes = read_data(settings, (unsigned int *)dest,
+            settings->bytes);
+        trace_span("read_data", t_read);
+        metrics_add(METRIC_BYTES_READ, r_bytes);
+
+        if (arrival != NULL)
+        {
+            arrival[k] = trace_now();
+        }
+
+        if (r_bytes != settings->bytes)
+        {
+            // Number of bytes read does not match number of bytes required
+            fprintf(stderr, "Unable to read %d bytes (only read %d bytes)\n",
+                settings->bytes, r_bytes);
+
+            // Indicates EOF (with some data unused), keep the whole loops
+            // read so far and stop handing out work
+            scheduler_eof = 1;
+            claimed = k;
+        }
+    }
+
+    // Keep the end of the claim as the history of the next one
+    if (claimed > 0 && settings->history > 0 &&
+        settings->input_type != INPUT_SYNTH)
+    {
+        memcpy(h_data, scheduler_history, settings->history);
+        memcpy(scheduler_history, loops_data + (size_t)claimed*settings->bytes -
+            settings->history, settings->history);
+    }
+
+    *loop = scheduler_next;
+    scheduler_next += claimed;
+
+    pthread_mutex_unlock(&scheduler_lock);
+
+    return claimed;
+}
+
+/*
+ * Records how long a worker took per loop for its last claim.
+ */
+void scheduler_complete(int worker, double loop_time)
+{
+    pthread_mutex_lock(&scheduler_lock);
+
+    if (scheduler_loop_time[worker] == 0)
+    {
+        scheduler_loop_time[worker] = loop_time;
+    }
+    else
+    {
+        scheduler_loop_time[worker] += LOOP_TIME_WEIGHT*
+            (loop_time - scheduler_loop_time[worker]);
+    }
+
+    pthread_mutex_unlock(&scheduler_lock);
+}
+
+/*
+ * Chooses how many loops a worker processes per kernel launch. A fixed value
+ * may be given with --superbatch, otherwise the smallest power of two which
+ * reaches SUPERBATCH_SAMPLES per launch is used, limited by the memory of the
+ * worker's device and by the number of loops requested.
+ */
+int scheduler_superbatch(ga_settings *settings, cl_vars *cl)
+{
+    cl_ulong    global_mem;
+    cl_ulong    max_alloc;
+    cl_ulong    largest;
+    int         k;
+
+    if (settings->superbatch != 0)
+    {
+        return settings->superbatch;
+    }
+
+    // Retrieve the device memory limits
+    plan_device_memory(cl, &global_mem, &max_alloc);
+
+    k = 1;
+    while ((cl_ulong)k*settings->data_length < SUPERBATCH_SAMPLES &&
+        k < SUPERBATCH_MAX &&
+        plan_memory(settings, settings->batch_size, 2*k, &largest) <=
+        global_mem/2 && largest <= max_alloc &&
+        (settings->loops == 0 || 2*k <= settings->loops))
+    {
+        k *= 2;
+    }
+
+    fprintf(stderr, "[Device %d] Super-batch size = %d loops\n",
+        cl->device_id, k);
+
+    return k;
+}
@@ -0,0 +1,10 @@
+// An automatically sized super-batch aims for this many complex samples per
+// launch, but never holds more than SUPERBATCH_MAX loops to bound latency
+#define SUPERBATCH_SAMPLES  (1 << 22)
+#define SUPERBATCH_MAX      64
+
+void scheduler_initialise(ga_settings *settings, int n_workers);
+int scheduler_claim(ga_settings *settings, int worker, unsigned int *h_data,
+    int max_loops, long long *loop, double *arrival);
+void scheduler_complete(int worker, double loop_time);
+int scheduler_superbatch(ga_settings *settings, cl_vars *cl);
@@ -4,12 +4,28 @@
 #include "main.h"
 #include "cl_abstractions.h"
 #include "cl_error.h"
+#include "trace.h"
 #include "spectrum.h"
 
-cl_kernel *zero_kernel;
-cl_kernel *add_kernel;
+WORKER_LOCAL cl_kernel *zero_kernel;
+WORKER_LOCAL cl_kernel *add_kernel;
+WORKER_LOCAL cl_kernel *select_kernel;
 
-void spectrum_initialise(cl_vars *cl)
+// Work sizes and bound buffers, computed once and reused every call
+WORKER_LOCAL size_t  spectrum_global_size[1];
+WORKER_LOCAL size_t  spectrum_local_size[1];
+WORKER_LOCAL cl_mem  zero_bound;
+WORKER_LOCAL cl_mem  add_bound[2];
+WORKER_LOCAL size_t  select_global_size[1];
+WORKER_LOCAL cl_mem  select_map;
+WORKER_LOCAL cl_mem  select_bound[2];
+
+/*
+ * Builds the spectrum kernels and computes their work size, which is the same
+ * for every call. When bins are selected, the map of selected bins is copied
+ * to the device once.
+ */
+void spectrum_initialise(ga_settings *settings, cl_vars *cl)
 {
     cl_int      err_ret;
     cl_program  *program;
@@ -23,27 +39,61 @@ void spectrum_initialise(cl_vars *cl)
     cl_create_kernel(cl, program, zero_kernel, "zero_spectrum");
     add_kernel = malloc(sizeof(cl_kernel));
     cl_create_kernel(cl, program, add_kernel, "add_spectrum");
+
+    // Set work size
+    int nt = MIN(settings->output_length, cl->max_work_size);
+    spectrum_global_size[0] = settings->output_length;
+    spectrum_local_size[0] = nt;
+
+    if (settings->select_length == 0)
+    {
+        return;
+    }
+
+    select_kernel = malloc(sizeof(cl_kernel));
+    cl_create_kernel(cl, program, select_kernel, "select_spectrum");
+
+    // The number of selected bins may be anything, so the local size is left
+    // to the runtime, which picks one that divides it
+    select_global_size[0] = settings->dump_length;
+
+    select_map = clCreateBuffer(cl->context,
+        CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+        settings->select_length*sizeof(cl_int2), settings->select_map,
+        &err_ret);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    // Set the kernel arguments which are constant for the whole run
+    int row_length = settings->output_length/settings->channels;
+    err_ret = clSetKernelArg(*select_kernel, 2, sizeof(select_map),
+        (void *)&select_map);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*select_kernel, 3, sizeof(row_length),
+        (void *)&row_length);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*select_kernel, 4,
+        sizeof(settings->select_length), (void *)&settings->select_length);
+    check_error(__FILE__, __LINE__, err_ret);
 }
 
 void zero_spectrum(ga_settings *settings, cl_vars *cl, cl_mem dev_spectrum)
 {
     cl_int      err_ret;
-    size_t      global_work_size[1];
-    size_t      local_work_size[1];
 
-    // Set work size
-    int nt = MIN(settings->output_length, cl->max_work_size);
-    global_work_size[0] = settings->output_length;
-    local_work_size[0] = nt;
-
-    // Set kernel arguments
-    err_ret = clSetKernelArg(*zero_kernel, 0, sizeof(dev_spectrum),
-        (void *)&dev_spectrum);
-    check_error(__FILE__, __LINE__, err_ret);
+    // Rebind the buffer if it has changed
+    if (dev_spectrum != zero_bound)
+    {
+        err_ret = clSetKernelArg(*zero_kernel, 0, sizeof(dev_spectrum),
+            (void *)&dev_spectrum);
+        check_error(__FILE__, __LINE__, err_ret);
+        zero_bound = dev_spectrum;
+    }
 
     // Execute kernel
+    cl_event *event = trace_enqueue_begin("zero_spectrum");
     err_ret = clEnqueueNDRangeKernel(cl->queue, *zero_kernel, 1, NULL,
-        global_work_size, local_work_size, 0, NULL, NULL);
+        spectrum_global_size, spectrum_local_size, 0, NULL, event);
+    trace_enqueue_end(event);
     check_error(__FILE__, __LINE__, err_ret);
 }
 
@@ -52,22 +102,61 @@ void add_spectrum(ga_settings *settings, cl_vars *cl, cl_mem dev_a,
 {
     cl_int      err_ret;
 
-    size_t  global_work_size[1];
-    size_t  local_work_size[1];
+    // Rebind the buffers if they have changed
+    if (dev_a != add_bound[0])
+    {
+        err_ret = clSetKernelArg(*add_kernel, 0, sizeof(dev_a),
+            (void *)&dev_a);
+        check_error(__FILE__, __LINE__, err_ret);
+        add_bound[0] = dev_a;
+    }
 
-    // Set work size
-    int nt = MIN(settings->output_length, cl->max_work_size);
-    global_work_size[0] = settings->output_length;
-    local_work_size[0] = nt;
+    if (dev_b != add_bound[1])
+    {
+        err_ret = clSetKernelArg(*add_kernel, 1, sizeof(dev_b),
+            (void *)&dev_b);
+        check_error(__FILE__, __LINE__, err_ret);
+        add_bound[1] = dev_b;
+    }
 
-    // Set kernel arguments
-    err_ret = clSetKernelArg(*add_kernel, 0, sizeof(dev_a), (void *)&dev_a);
-    check_error(__FILE__, __LINE__, err_ret);
-    err_ret = clSetKernelArg(*add_kernel, 1, sizeof(dev_b), (void *)&dev_b);
+    // Execute kernel
+    cl_event *event = trace_enqueue_begin("add_spectrum");
+    err_ret = clEnqueueNDRangeKernel(cl->queue, *add_kernel, 1, NULL,
+        spectrum_global_size, spectrum_local_size, 0, NULL, event);
+    trace_enqueue_end(event);
     check_error(__FILE__, __LINE__, err_ret);
+}
+
+/*
+ * Compacts the spectrum in dev_in into the selected bins of each channel in
+ * dev_out, which holds dump_length values.
+ */
+void select_spectrum(ga_settings *settings, cl_vars *cl, cl_mem dev_in,
+    cl_mem dev_out)
+{
+    cl_int      err_ret;
+
+    // Rebind the buffers if they have changed
+    if (dev_in != select_bound[0])
+    {
+        err_ret = clSetKernelArg(*select_kernel, 0, sizeof(dev_in),
+            (void *)&dev_in);
+        check_error(__FILE__, __LINE__, err_ret);
+        select_bound[0] = dev_in;
+    }
+
+    if (dev_out != select_bound[1])
+    {
+        err_ret = clSetKernelArg(*select_kernel, 1, sizeof(dev_out),
+            (void *)&dev_out);
+        check_error(__FILE__, __LINE__, err_ret);
+        select_bound[1] = dev_out;
+    }
 
     // Execute kernel
-    err_ret = clEnqueueNDRangeKernel(cl->queue, *add_kernel, 1, NULL,
-        global_work_size, local_work_size, 0, NULL, NULL);
+    cl_event *event = trace_enqueue_begin("select_spectrum");
+    err_ret = clEnqueueNDRangeKernel(cl->queue, *select_kernel, 1, NULL,
+        select_global_size, NULL, 0, NULL, event);
+    trace_enqueue_end(event);
     check_error(__FILE__, __LINE__, err_ret);
 }
@@ -13,3 +13,26 @@ __kernel void add_spectrum(__global const float2 *a, __global float2 *b)
     b[idx].x += a[idx].x;
     b[idx].y += a[idx].y;
 }
+
+/*
+ * Compacts each channel of a spectrum into the selected output bins. Output
+ * bin j of a channel is the mean of map[j].y input bins starting at bin
+ * map[j].x, so ranges of bins are kept and adjacent bins averaged in one pass
+ * before the spectrum is copied back.
+ */
+__kernel void select_spectrum(__global const float2 *in, __global float2 *out,
+    __global const int2 *map, __const int row_length,
+    __const int select_length)
+{
+    int idx = get_global_id(0);
+    int row = idx/select_length;
+    int2 m = map[idx%select_length];
+
+    float2 acc = (float2)(0, 0);
+    for (int i = 0; i < m.y; i++)
+    {
+        acc += in[row*row_length + m.x + i];
+    }
+
+    out[idx] = acc/m.y;
+}
@@ -1,4 +1,6 @@
-void spectrum_initialise(cl_vars *cl);
+void spectrum_initialise(ga_settings *settings, cl_vars *cl);
 void zero_spectrum(ga_settings *settings, cl_vars *cl, cl_mem dev_spectrum);
 void add_spectrum(ga_settings *settings, cl_vars *cl, cl_mem dev_a,
     cl_mem dev_b);
+void select_spectrum(ga_settings *settings, cl_vars *cl, cl_mem dev_in,
+    cl_mem dev_out);
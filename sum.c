@@ -3,55 +3,224 @@
 #include "main.h"
 #include "cl_abstractions.h"
 #include "cl_error.h"
+#include "trace.h"
 #include "sum.h"
 
-cl_kernel *sum_kernel;
+WORKER_LOCAL cl_program *sum_program;
+WORKER_LOCAL cl_kernel *sum_kernel;
 
-void sum_initialise(cl_vars *cl)
+// Work sizes and bound buffers, computed once and reused every loop
+WORKER_LOCAL size_t  sum_global_size[1];
+WORKER_LOCAL size_t  sum_local_size[1];
+WORKER_LOCAL cl_mem  sum_data;
+WORKER_LOCAL cl_mem  sum_spectrum;
+WORKER_LOCAL cl_mem  sum_waterfall;
+WORKER_LOCAL int     sum_loops;
+
+// Kernels of the additional resolutions, which sum separate buffers, and
+// the arguments bound to each
+WORKER_LOCAL cl_kernel **resolution_kernels;
+WORKER_LOCAL cl_mem    *resolution_data;
+WORKER_LOCAL cl_mem    *resolution_spectra;
+WORKER_LOCAL int       *resolution_loops;
+
+/*
+ * Builds a sum kernel for spectra of the given number of bins, which also
+ * writes the rows of the waterfall if asked to, and sets the arguments which
+ * do not change between loops. The program is only built once per worker.
+ */
+cl_kernel *sum_create_kernel(ga_settings *settings, cl_vars *cl, int bins,
+    int waterfall)
 {
     cl_int      err_ret;
-    cl_program  *program;
+    cl_kernel   *kernel;
 
     // Create the program
-    program = malloc(sizeof(cl_program));
-    cl_create_program(cl, program, "sum.cl");
+    if (sum_program == NULL)
+    {
+        sum_program = malloc(sizeof(cl_program));
+        cl_create_program(cl, sum_program, "sum.cl");
+    }
 
     // Create the kernel
-    sum_kernel = malloc(sizeof(cl_kernel));
-    cl_create_kernel(cl, program, sum_kernel, "sum");
+    kernel = malloc(sizeof(cl_kernel));
+    if (waterfall && settings->packed)
+    {
+        cl_create_kernel(cl, sum_program, kernel, "sum_waterfall_packed");
+    }
+    else if (waterfall)
+    {
+        cl_create_kernel(cl, sum_program, kernel, "sum_waterfall");
+    }
+    else if (settings->packed)
+    {
+        cl_create_kernel(cl, sum_program, kernel, "sum_packed");
+    }
+    else if (settings->zoom > 1)
+    {
+        cl_create_kernel(cl, sum_program, kernel, "sum_zoom");
+    }
+    else
+    {
+        cl_create_kernel(cl, sum_program, kernel, "sum");
+    }
+
+    // Samples per channel in the data buffer, fewer when zoomed, and the
+    // number of FFTs of each channel in a loop
+    int spc = settings->spc/settings->zoom;
+    int batch_size = spc/bins;
+
+    // Set the kernel arguments which are constant for the whole run
+    err_ret = clSetKernelArg(*kernel, 2, sizeof(batch_size),
+        (void *)&batch_size);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*kernel, 3, sizeof(spc), (void *)&spc);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*kernel, 4, sizeof(bins), (void *)&bins);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*kernel, 6, sizeof(settings->data_length),
+        (void *)&settings->data_length);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    if (waterfall)
+    {
+        err_ret = clSetKernelArg(*kernel, 8, sizeof(settings->decimate),
+            (void *)&settings->decimate);
+        check_error(__FILE__, __LINE__, err_ret);
+    }
+
+    return kernel;
 }
 
-void sum_module(ga_settings *settings, cl_vars *cl, cl_mem dev_data,
-    cl_mem dev_spectrum)
+/*
+ * Builds the sum kernel and sets the arguments which do not change between
+ * loops. The rows of the waterfall are written by the same kernel whenever
+ * the waterfall is written or searched, so the data is only read once.
+ */
+void sum_initialise(ga_settings *settings, cl_vars *cl)
+{
+    sum_kernel = sum_create_kernel(settings, cl, settings->bins,
+        settings->waterfall_file != NULL || settings->trigger_file != NULL);
+
+    // Set work size
+    int nt = MIN(settings->output_length, cl->max_work_size);
+    sum_global_size[0] = settings->output_length;
+    sum_local_size[0] = nt;
+
+    sum_waterfall = NULL;
+    sum_loops = 0;
+
+    if (settings->n_resolutions > 0)
+    {
+        resolution_kernels = malloc(settings->n_resolutions*
+            sizeof(cl_kernel *));
+        resolution_data = calloc(settings->n_resolutions, sizeof(cl_mem));
+        resolution_spectra = calloc(settings->n_resolutions, sizeof(cl_mem));
+        resolution_loops = calloc(settings->n_resolutions, sizeof(int));
+
+        for (int r = 0; r < settings->n_resolutions; r++)
+        {
+            resolution_kernels[r] = sum_create_kernel(settings, cl,
+                settings->resolutions[r], 0);
+        }
+    }
+}
+
+/*
+ * Executes the sum kernel of additional resolution r over the given number of
+ * consecutive loops, adding the transformed data in dev_data to that
+ * resolution's spectrum. The arguments are only rebound if they have changed.
+ */
+void sum_resolution_module(ga_settings *settings, cl_vars *cl, int r,
+    cl_mem dev_data, cl_mem dev_spectrum, int loops)
 {
     cl_int      err_ret;
-    cl_kernel   *kernel;
+    cl_kernel   *kernel = resolution_kernels[r];
     size_t      global_work_size[1];
     size_t      local_work_size[1];
 
-    // Set work size
-    int nt = MIN(settings->output_length, cl->max_work_size);
-    global_work_size[0] = settings->output_length;
-    local_work_size[0] = nt;
+    // Rebind the arguments if they have changed
+    if (dev_data != resolution_data[r])
+    {
+        err_ret = clSetKernelArg(*kernel, 0, sizeof(dev_data),
+            (void *)&dev_data);
+        check_error(__FILE__, __LINE__, err_ret);
+        resolution_data[r] = dev_data;
+    }
 
-    // Set kernel arguments
-    err_ret = clSetKernelArg(*sum_kernel, 0, sizeof(dev_data),
-        (void *)&dev_data);
-    check_error(__FILE__, __LINE__, err_ret);
-    err_ret = clSetKernelArg(*sum_kernel, 1, sizeof(dev_spectrum),
-        (void *)&dev_spectrum);
-    check_error(__FILE__, __LINE__, err_ret);
-    err_ret = clSetKernelArg(*sum_kernel, 2, sizeof(settings->batch_size),
-        (void *)&settings->batch_size);
-    check_error(__FILE__, __LINE__, err_ret);
-    err_ret = clSetKernelArg(*sum_kernel, 3, sizeof(settings->spc),
-        (void *)&settings->spc);
+    if (dev_spectrum != resolution_spectra[r])
+    {
+        err_ret = clSetKernelArg(*kernel, 1, sizeof(dev_spectrum),
+            (void *)&dev_spectrum);
+        check_error(__FILE__, __LINE__, err_ret);
+        resolution_spectra[r] = dev_spectrum;
+    }
+
+    if (loops != resolution_loops[r])
+    {
+        err_ret = clSetKernelArg(*kernel, 5, sizeof(loops), (void *)&loops);
+        check_error(__FILE__, __LINE__, err_ret);
+        resolution_loops[r] = loops;
+    }
+
+    // Execute kernel
+    global_work_size[0] = settings->resolution_lengths[r];
+    local_work_size[0] = MIN(global_work_size[0], cl->max_work_size);
+    cl_event *event = trace_enqueue_begin("sum_resolution");
+    err_ret = clEnqueueNDRangeKernel(cl->queue, *kernel, 1, NULL,
+        global_work_size, local_work_size, 0, NULL, event);
+    trace_enqueue_end(event);
     check_error(__FILE__, __LINE__, err_ret);
-    err_ret = clSetKernelArg(*sum_kernel, 4, sizeof(settings->bins),
-        (void *)&settings->bins);
+}
+
+/*
+ * Executes the sum kernel over the given number of consecutive loops,
+ * rebinding the arguments only if they have changed. In the waterfall mode
+ * the rows of each loop are written to dev_waterfall, which is otherwise
+ * NULL.
+ */
+void sum_module(ga_settings *settings, cl_vars *cl, cl_mem dev_data,
+    cl_mem dev_spectrum, cl_mem dev_waterfall, int loops)
+{
+    cl_int      err_ret;
+
+    // Rebind the buffers if they have changed
+    if (dev_data != sum_data)
+    {
+        err_ret = clSetKernelArg(*sum_kernel, 0, sizeof(dev_data),
+            (void *)&dev_data);
+        check_error(__FILE__, __LINE__, err_ret);
+        sum_data = dev_data;
+    }
+
+    if (dev_spectrum != sum_spectrum)
+    {
+        err_ret = clSetKernelArg(*sum_kernel, 1, sizeof(dev_spectrum),
+            (void *)&dev_spectrum);
+        check_error(__FILE__, __LINE__, err_ret);
+        sum_spectrum = dev_spectrum;
+    }
+
+    if (dev_waterfall != sum_waterfall)
+    {
+        err_ret = clSetKernelArg(*sum_kernel, 7, sizeof(dev_waterfall),
+            (void *)&dev_waterfall);
+        check_error(__FILE__, __LINE__, err_ret);
+        sum_waterfall = dev_waterfall;
+    }
+
+    if (loops != sum_loops)
+    {
+        err_ret = clSetKernelArg(*sum_kernel, 5, sizeof(loops),
+            (void *)&loops);
+        check_error(__FILE__, __LINE__, err_ret);
+        sum_loops = loops;
+    }
 
     // Execute kernel
+    cl_event *event = trace_enqueue_begin("sum");
     err_ret = clEnqueueNDRangeKernel(cl->queue, *sum_kernel, 1, NULL,
-        global_work_size, local_work_size, 0, NULL, NULL);
+        sum_global_size, sum_local_size, 0, NULL, event);
+    trace_enqueue_end(event);
     check_error(__FILE__, __LINE__, err_ret);
 }
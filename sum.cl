@@ -1,20 +1,215 @@
+/*
+ * The sum kernels may be launched over several loops at once, each stride
+ * complex samples apart in the data buffer. Each loop is summed separately and
+ * added to the spectrum in turn, so the result is identical to launching once
+ * per loop.
+ */
 __kernel void sum(__global const float2 *data,__global float2 *spectrum,
-    __const int batch_size, __const int spc, __const int bins)
+    __const int batch_size, __const int spc, __const int bins,
+    __const int loops, __const int stride)
 {
     int idx = get_global_id(0);
     int a = (idx/(bins/2))*spc + idx%(bins/2);
 
-    float x = 0;
-    float y = 0;
-    for (int s = 0; s < batch_size; s++)
+    float2 acc = spectrum[idx];
+    for (int k = 0; k < loops; k++)
     {
-        int d = a + s*bins;
+        float x = 0;
+        float y = 0;
+        for (int s = 0; s < batch_size; s++)
+        {
+            int d = k*stride + a + s*bins;
 
-        // TODO: Should be able to calculate cross polarisations here
-        x += sqrt(data[d].x*data[d].x + data[d].y*data[d].y);
-        y += 0;
+            // TODO: Should be able to calculate cross polarisations here
+            x += sqrt(data[d].x*data[d].x + data[d].y*data[d].y);
+            y += 0;
+        }
+
+        acc.x += x;
+        acc.y += y;
+    }
+
+    spectrum[idx] = acc;
+}
+
+/*
+ * Sums the output of the packed convert kernels. For a complex FFT Z of two
+ * real signals packed as x + iy, X[k] = (Z[k] + conj(Z[N-k]))/2 and
+ * Y[k] = (Z[k] - conj(Z[N-k]))/2i, so each channel of a pair is recovered from
+ * bins k and N-k of the shared transform.
+ */
+__kernel void sum_packed(__global const float2 *data,__global float2 *spectrum,
+    __const int batch_size, __const int spc, __const int bins,
+    __const int loops, __const int stride)
+{
+    int idx = get_global_id(0);
+    int c = idx/(bins/2);
+    int k = idx%(bins/2);
+    int a = (c/2)*spc + k;
+    int b = (c/2)*spc + (bins - k)%bins;
+
+    float2 acc = spectrum[idx];
+    for (int l = 0; l < loops; l++)
+    {
+        float x = 0;
+        float y = 0;
+        for (int s = 0; s < batch_size; s++)
+        {
+            float2 z = data[l*stride + a + s*bins];
+            float2 w = data[l*stride + b + s*bins];
+
+            if (c%2 == 0)
+            {
+                x += 0.5f*sqrt((z.x + w.x)*(z.x + w.x) +
+                    (z.y - w.y)*(z.y - w.y));
+            }
+            else
+            {
+                x += 0.5f*sqrt((z.x - w.x)*(z.x - w.x) +
+                    (z.y + w.y)*(z.y + w.y));
+            }
+            y += 0;
+        }
+
+        acc.x += x;
+        acc.y += y;
+    }
+
+    spectrum[idx] = acc;
+}
+
+/*
+ * Sums the output of the zoom kernel, where each channel is a complex
+ * narrowband stream spc samples long. Every bin of the FFT is kept, and they
+ * are reordered so each channel's spectrum runs from the lowest frequency to
+ * the highest, with the zoom band's centre in bin bins/2.
+ */
+__kernel void sum_zoom(__global const float2 *data,__global float2 *spectrum,
+    __const int batch_size, __const int spc, __const int bins,
+    __const int loops, __const int stride)
+{
+    int idx = get_global_id(0);
+    int k = (idx%bins + bins/2)%bins;
+    int a = (idx/bins)*spc + k;
+
+    float2 acc = spectrum[idx];
+    for (int l = 0; l < loops; l++)
+    {
+        float x = 0;
+        float y = 0;
+        for (int s = 0; s < batch_size; s++)
+        {
+            int d = l*stride + a + s*bins;
+
+            x += sqrt(data[d].x*data[d].x + data[d].y*data[d].y);
+            y += 0;
+        }
+
+        acc.x += x;
+        acc.y += y;
+    }
+
+    spectrum[idx] = acc;
+}
+
+/*
+ * The sum kernel of the waterfall mode. As well as adding each loop to the
+ * spectrum, every group of decimate FFT frames is averaged into one row of
+ * the waterfall, rows rows per loop, in the same pass over the data.
+ */
+__kernel void sum_waterfall(__global const float2 *data,
+    __global float2 *spectrum, __const int batch_size, __const int spc,
+    __const int bins, __const int loops, __const int stride,
+    __global float *waterfall, __const int decimate)
+{
+    int idx = get_global_id(0);
+    int a = (idx/(bins/2))*spc + idx%(bins/2);
+    int rows = batch_size/decimate;
+
+    float2 acc = spectrum[idx];
+    for (int k = 0; k < loops; k++)
+    {
+        float x = 0;
+        float y = 0;
+        float row = 0;
+        for (int s = 0; s < batch_size; s++)
+        {
+            int d = k*stride + a + s*bins;
+            float v = sqrt(data[d].x*data[d].x + data[d].y*data[d].y);
+
+            x += v;
+            y += 0;
+            row += v;
+
+            if ((s + 1)%decimate == 0)
+            {
+                waterfall[(k*rows + s/decimate)*get_global_size(0) + idx] =
+                    row/decimate;
+                row = 0;
+            }
+        }
+
+        acc.x += x;
+        acc.y += y;
+    }
+
+    spectrum[idx] = acc;
+}
+
+/*
+ * Waterfall sum for the packed data layout, separating each pair of channels
+ * in the same way as sum_packed.
+ */
+__kernel void sum_waterfall_packed(__global const float2 *data,
+    __global float2 *spectrum, __const int batch_size, __const int spc,
+    __const int bins, __const int loops, __const int stride,
+    __global float *waterfall, __const int decimate)
+{
+    int idx = get_global_id(0);
+    int c = idx/(bins/2);
+    int k = idx%(bins/2);
+    int a = (c/2)*spc + k;
+    int b = (c/2)*spc + (bins - k)%bins;
+    int rows = batch_size/decimate;
+
+    float2 acc = spectrum[idx];
+    for (int l = 0; l < loops; l++)
+    {
+        float x = 0;
+        float y = 0;
+        float row = 0;
+        for (int s = 0; s < batch_size; s++)
+        {
+            float2 z = data[l*stride + a + s*bins];
+            float2 w = data[l*stride + b + s*bins];
+            float v;
+
+            if (c%2 == 0)
+            {
+                v = 0.5f*sqrt((z.x + w.x)*(z.x + w.x) +
+                    (z.y - w.y)*(z.y - w.y));
+            }
+            else
+            {
+                v = 0.5f*sqrt((z.x - w.x)*(z.x - w.x) +
+                    (z.y + w.y)*(z.y + w.y));
+            }
+
+            x += v;
+            y += 0;
+            row += v;
+
+            if ((s + 1)%decimate == 0)
+            {
+                waterfall[(l*rows + s/decimate)*get_global_size(0) + idx] =
+                    row/decimate;
+                row = 0;
+            }
+        }
+
+        acc.x += x;
+        acc.y += y;
     }
 
-    spectrum[idx].x += x;
-    spectrum[idx].y += y;
+    spectrum[idx] = acc;
 }
@@ -1,3 +1,5 @@
-void sum_initialise(cl_vars *cl);
+void sum_initialise(ga_settings *settings, cl_vars *cl);
 void sum_module(ga_settings *settings, cl_vars *cl, cl_mem dev_data,
-    cl_mem dev_spectrum);
+    cl_mem dev_spectrum, cl_mem dev_waterfall, int loops);
+void sum_resolution_module(ga_settings *settings, cl_vars *cl, int r,
+    cl_mem dev_data, cl_mem dev_spectrum, int loops);
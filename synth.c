@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <CL/opencl.h>
+
+#include "main.h"
+#include "cl_abstractions.h"
+#include "cl_error.h"
+#include "trace.h"
+#include "synth.h"
+
+// Quantisation threshold in units of the signal's RMS which loses the least
+// signal to noise for 2-bit samples
+#define SYNTH_THRESHOLD 0.9816
+
+WORKER_LOCAL cl_kernel *synth_kernel;
+
+// Work sizes and bound buffers, computed once and reused every loop
+WORKER_LOCAL size_t  synth_global_size[1];
+WORKER_LOCAL size_t  synth_local_size[1];
+WORKER_LOCAL cl_mem  synth_input;
+WORKER_LOCAL cl_mem  synth_tones;
+WORKER_LOCAL cl_mem  synth_threshold;
+
+/*
+ * Builds the synth kernel and sets the arguments which do not change between
+ * loops: the tones, the quantisation thresholds and the encoding.
+ */
+void synth_initialise(ga_settings *settings, cl_vars *cl)
+{
+    cl_int      err_ret;
+    cl_program  *program;
+    cl_int4     codes;
+    cl_float    noise = settings->noise;
+
+    // Create the program
+    program = malloc(sizeof(cl_program));
+    cl_create_program(cl, program, "synth.cl");
+
+    // Create the kernel
+    synth_kernel = malloc(sizeof(cl_kernel));
+    cl_create_kernel(cl, program, synth_kernel, "synth_2bit");
+
+    // Set work size, one work item per time sample, in groups which also
+    // divide any history generated before the loops
+    int nt = MIN(settings->spc, cl->max_work_size);
+    if (settings->history > 0)
+    {
+        nt = MIN(nt, settings->history*8/(settings->channels*settings->bps));
+    }
+    synth_global_size[0] = settings->spc;
+    synth_local_size[0] = nt;
+
+    // Codes for each level from most negative to most positive, the inverse
+    // of the convert kernel's LUT
+    if (settings->bps == 2 && settings->encoding == ENC_VLBA)
+    {
+        codes.s[0] = 0;
+        codes.s[1] = 2;
+        codes.s[2] = 1;
+        codes.s[3] = 3;
+    }
+    else if (settings->bps == 2 && settings->encoding == ENC_AT)
+    {
+        codes.s[0] = 3;
+        codes.s[1] = 1;
+        codes.s[2] = 0;
+        codes.s[3] = 2;
+    }
+    else
+    {
+        fprintf(stderr, "Unknown encoding\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Set each channel's threshold from the total power of its noise and
+    // tones, as the sampler's level setting would
+    cl_float *threshold = malloc(settings->channels*sizeof(cl_float));
+
+    for (int c = 0; c < settings->channels; c++)
+    {
+        double power = settings->noise*settings->noise;
+
+        for (int i = 0; i < settings->n_tones; i++)
+        {
+            if ((int)settings->tones[4*i] == c)
+            {
+                power += settings->tones[4*i + 2]*settings->tones[4*i + 2]/2;
+            }
+        }
+
+        threshold[c] = SYNTH_THRESHOLD*sqrt(power);
+    }
+
+    // Copy the tones and thresholds to the device, with at least one tone so
+    // that the buffer is never empty
+    cl_float4   no_tone = {{0, 0, 0, 0}};
+    int         n_tones = settings->n_tones;
+    void        *tones = settings->tones;
+
+    if (n_tones == 0)
+    {
+        n_tones = 1;
+        tones = &no_tone;
+    }
+
+    synth_tones = clCreateBuffer(cl->context,
+        CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, n_tones*sizeof(cl_float4),
+        tones, &err_ret);
+    check_error(__FILE__, __LINE__, err_ret);
+    synth_threshold = clCreateBuffer(cl->context,
+        CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+        settings->channels*sizeof(cl_float), threshold, &err_ret);
+    check_error(__FILE__, __LINE__, err_ret);
+    free(threshold);
+
+    // Set the kernel arguments which are constant for the whole run
+    err_ret = clSetKernelArg(*synth_kernel, 1, sizeof(synth_tones),
+        (void *)&synth_tones);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*synth_kernel, 2, sizeof(synth_threshold),
+        (void *)&synth_threshold);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*synth_kernel, 3, sizeof(settings->n_tones),
+        (void *)&settings->n_tones);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*synth_kernel, 4, sizeof(settings->channels),
+        (void *)&settings->channels);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*synth_kernel, 5, sizeof(settings->bins),
+        (void *)&settings->bins);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*synth_kernel, 6, sizeof(noise), (void *)&noise);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*synth_kernel, 7, sizeof(codes), (void *)&codes);
+    check_error(__FILE__, __LINE__, err_ret);
+}
+
+/*
+ * Generates the given number of consecutive loops of input directly in the
+ * input buffer, starting at loop, along with the history which precedes them.
+ * The loops are numbered from the start of the stream, so --offset gives the
+ * same samples as it would for a file.
+ */
+void synth_module(ga_settings *settings, cl_vars *cl, cl_mem dev_input,
+    long long loop, int loops)
+{
+    cl_int      err_ret;
+    size_t      global_work_size[1];
+    cl_ulong    first_sample;
+
+    // Rebind the buffer if it has changed
+    if (dev_input != synth_input)
+    {
+        err_ret = clSetKernelArg(*synth_kernel, 0, sizeof(dev_input),
+            (void *)&dev_input);
+        check_error(__FILE__, __LINE__, err_ret);
+        synth_input = dev_input;
+    }
+
+    int history = settings->history*8/(settings->channels*settings->bps);
+    first_sample = (cl_ulong)(settings->offset/settings->bytes + loop)*
+        settings->spc - history;
+    err_ret = clSetKernelArg(*synth_kernel, 8, sizeof(first_sample),
+        (void *)&first_sample);
+    check_error(__FILE__, __LINE__, err_ret);
+
+    // Execute kernel
+    global_work_size[0] = loops*synth_global_size[0] + history;
+    cl_event *event = trace_enqueue_begin("synth");
+    err_ret = clEnqueueNDRangeKernel(cl->queue, *synth_kernel, 1, NULL,
+        global_work_size, synth_local_size, 0, NULL, event);
+    trace_enqueue_end(event);
+    check_error(__FILE__, __LINE__, err_ret);
+}
@@ -0,0 +1,69 @@
+/*
+ * Hashes a 32-bit value. Chained over a sample's position in the stream and
+ * its channel, this is a counter-based random number generator: every sample
+ * is independent of the others and of how the loops are split between
+ * launches and devices.
+ */
+uint synth_hash(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+
+    return x;
+}
+
+/*
+ * Generates 2-bit samples in the input buffer, one time sample of every
+ * channel per work item. Each channel holds Gaussian noise with standard
+ * deviation noise plus any tones for that channel, where a tone (channel,
+ * bin, amplitude) is a cosine centred on the given FFT bin. The samples are
+ * quantised at +/-threshold[c] and encoded with codes, which holds the code
+ * for each level from most negative to most positive, so the convert kernel
+ * decodes them with its usual LUT.
+ */
+__kernel void synth_2bit(__global unsigned char *input,
+    __constant float4 *tones, __constant float *threshold,
+    __const int n_tones, __const int channels, __const int bins,
+    __const float noise, __const int4 codes, __const ulong first_sample)
+{
+    int idx = get_global_id(0);
+    ulong t = first_sample + idx;
+
+    // Interpet the codes as an array
+    int *cp = (int *)&codes;
+
+    uint word = 0;
+    for (int c = 0; c < channels; c++)
+    {
+        // Two uniform variates from the sample's position, then Box-Muller
+        uint key = synth_hash((uint)t ^
+            synth_hash((uint)(t >> 32) ^ synth_hash(c)));
+        float u1 = (synth_hash(key) + 0.5f)/4294967296.0f;
+        float u2 = synth_hash(key ^ 0x9e3779b9U)/4294967296.0f;
+        float x = noise*sqrt(-2*log(u1))*cospi(2*u2);
+
+        // Add the tones, with the phase reduced to whole frames first
+        for (int i = 0; i < n_tones; i++)
+        {
+            if ((int)tones[i].x == c)
+            {
+                ulong phase = ((t%bins)*(ulong)tones[i].y)%bins;
+                x += tones[i].z*cospi(2.0f*phase/bins);
+            }
+        }
+
+        // Quantise to one of the four levels
+        float thr = threshold[c];
+        int level = (x < -thr) ? 0 : (x < 0) ? 1 : (x < thr) ? 2 : 3;
+        word |= cp[level] << (2*c);
+    }
+
+    // Each time sample takes a byte for every four channels
+    for (int b = 0; b < channels/4; b++)
+    {
+        input[idx*(channels/4) + b] = (word >> (8*b)) & 0xff;
+    }
+}
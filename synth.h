@@ -0,0 +1,3 @@
+void synth_initialise(ga_settings *settings, cl_vars *cl);
+void synth_module(ga_settings *settings, cl_vars *cl, cl_mem dev_input,
+    long long loop, int loops);
@@ -0,0 +1,278 @@
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <CL/opencl.h>
+
+#include "main.h"
+#include "cl_error.h"
+#include "trace.h"
+
+// Events kept per thread, older events are overwritten once this is reached
+#define TRACE_EVENTS    (1 << 18)
+
+// Device commands which have been enqueued but not yet collected
+#define TRACE_PENDING   64
+
+// Device queues are shown as their own tracks, offset from the host threads
+#define TRACE_DEVICE_TID    1000
+
+typedef struct
+{
+    const char  *name;
+    double      ts;         // Start time in microseconds
+    double      dur;        // Duration in microseconds
+    int         tid;        // Track the event is shown on
+} trace_event;
+
+typedef struct
+{
+    const char  *name;
+    double      enqueued;   // Host time the command was enqueued
+    cl_event    event;
+} trace_pending;
+
+typedef struct
+{
+    char            name[64];
+    int             tid;
+    int             device_tid;
+    long long       n_events;   // Total recorded, including overwritten
+    trace_event     *events;
+    int             n_pending;
+    trace_pending   pending[TRACE_PENDING];
+} trace_buffer;
+
+int             trace_enabled;
+struct timespec trace_epoch;
+
+// Every thread's buffer, so they can be written out at the end
+pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+trace_buffer    **trace_buffers;
+int             trace_n_buffers;
+
+WORKER_LOCAL trace_buffer *trace_local;
+
+/*
+ * Enables tracing if a trace file was requested.
+ */
+void trace_initialise(ga_settings *settings)
+{
+    if (settings->trace_file != NULL)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &trace_epoch);
+        trace_enabled = 1;
+    }
+}
+
+/*
+ * Returns the time in microseconds since tracing started.
+ */
+double trace_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - trace_epoch.tv_sec)*1e6 +
+        (now.tv_nsec - trace_epoch.tv_nsec)/1e3;
+}
+
+/*
+ * Creates the calling thread's ring buffer. Commands enqueued by the thread
+ * are shown on the track of the given device, if there is one.
+ */
+void trace_thread(char *name, int device_id)
+{
+    if (!trace_enabled)
+    {
+        return;
+    }
+
+    trace_local = calloc(1, sizeof(trace_buffer));
+    trace_local->events = malloc(TRACE_EVENTS*sizeof(trace_event));
+    strncpy(trace_local->name, name, sizeof(trace_local->name) - 1);
+    trace_local->device_tid = TRACE_DEVICE_TID + device_id;
+
+    pthread_mutex_lock(&trace_lock);
+    trace_local->tid = trace_n_buffers + 1;
+    trace_buffers = realloc(trace_buffers,
+        (trace_n_buffers + 1)*sizeof(trace_buffer *));
+    trace_buffers[trace_n_buffers++] = trace_local;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+ * Adds an event to the calling thread's ring buffer.
+ */
+void trace_record(const char *name, double ts, double dur, int tid)
+{
+    trace_event *e = &trace_local->events[trace_local->n_events %
+        TRACE_EVENTS];
+
+    e->name = name;
+    e->ts = ts;
+    e->dur = dur;
+    e->tid = tid;
+    trace_local->n_events++;
+}
+
+/*
+ * Records a span on the calling thread from start until now.
+ */
+void trace_span(const char *name, double start)
+{
+    if (trace_local != NULL)
+    {
+        trace_record(name, start, trace_now() - start, trace_local->tid);
+    }
+}
+
+/*
+ * Returns the event to pass to an enqueue call, or NULL if tracing is off.
+ * The enqueue call itself is timed until trace_enqueue_end.
+ */
+cl_event *trace_enqueue_begin(const char *name)
+{
+    if (trace_local == NULL || trace_local->n_pending == TRACE_PENDING)
+    {
+        return NULL;
+    }
+
+    trace_pending *p = &trace_local->pending[trace_local->n_pending];
+    p->name = name;
+    p->enqueued = trace_now();
+
+    return &p->event;
+}
+
+void trace_enqueue_end(cl_event *event)
+{
+    if (event != NULL)
+    {
+        trace_pending *p = &trace_local->pending[trace_local->n_pending++];
+        trace_record(p->name, p->enqueued, trace_now() - p->enqueued,
+            trace_local->tid);
+    }
+}
+
+/*
+ * Records the device execution of every completed command enqueued by the
+ * calling thread. Device timestamps are placed on the host timeline relative
+ * to the time each command was enqueued, so no clock synchronisation is
+ * needed. Commands which are still running are kept for the next call.
+ */
+void trace_collect(void)
+{
+    cl_int      err_ret;
+    cl_int      status;
+    cl_ulong    queued;
+    cl_ulong    start;
+    cl_ulong    end;
+    int         kept = 0;
+
+    if (trace_local == NULL)
+    {
+        return;
+    }
+
+    for (int i = 0; i < trace_local->n_pending; i++)
+    {
+        trace_pending *p = &trace_local->pending[i];
+
+        err_ret = clGetEventInfo(p->event, CL_EVENT_COMMAND_EXECUTION_STATUS,
+            sizeof(status), &status, NULL);
+        check_error(__FILE__, __LINE__, err_ret);
+
+        if (status != CL_COMPLETE)
+        {
+            trace_local->pending[kept++] = *p;
+            continue;
+        }
+
+        err_ret = clGetEventProfilingInfo(p->event,
+            CL_PROFILING_COMMAND_QUEUED, sizeof(queued), &queued, NULL);
+        check_error(__FILE__, __LINE__, err_ret);
+        err_ret = clGetEventProfilingInfo(p->event,
+            CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+        check_error(__FILE__, __LINE__, err_ret);
+        err_ret = clGetEventProfilingInfo(p->event,
+            CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+        check_error(__FILE__, __LINE__, err_ret);
+
+        trace_record(p->name, p->enqueued + (start - queued)/1e3,
+            (end - start)/1e3, trace_local->device_tid);
+        clReleaseEvent(p->event);
+    }
+
+    trace_local->n_pending = kept;
+}
+
+/*
+ * Writes every thread's events as Chrome trace event JSON, which can be
+ * opened in Perfetto or chrome://tracing.
+ */
+void trace_write(ga_settings *settings)
+{
+    FILE        *fp;
+    long long   dropped = 0;
+    int         first = 1;
+
+    if (!trace_enabled)
+    {
+        return;
+    }
+
+    fp = fopen(settings->trace_file, "w");
+
+    if (fp == NULL)
+    {
+        fprintf(stderr, "%s: ", settings->trace_file);
+        perror("");
+        return;
+    }
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+
+    for (int b = 0; b < trace_n_buffers; b++)
+    {
+        trace_buffer *buf = trace_buffers[b];
+
+        // Name the thread's track and its device's track
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%d,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n",
+            buf->tid, buf->name);
+        if (buf->device_tid >= TRACE_DEVICE_TID)
+        {
+            fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\","
+                "\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"Device %d "
+                "queue\"}}", buf->device_tid,
+                buf->device_tid - TRACE_DEVICE_TID);
+        }
+        first = 0;
+
+        // Write the events from oldest to newest
+        long long n = MIN(buf->n_events, TRACE_EVENTS);
+        dropped += buf->n_events - n;
+
+        for (long long i = buf->n_events - n; i < buf->n_events; i++)
+        {
+            trace_event *e = &buf->events[i % TRACE_EVENTS];
+            fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", e->name, e->tid,
+                e->ts, e->dur);
+        }
+    }
+
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+
+    if (dropped > 0)
+    {
+        fprintf(stderr, "Trace: %lld oldest events were overwritten\n",
+            dropped);
+    }
+}
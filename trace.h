@@ -0,0 +1,8 @@
+void trace_initialise(ga_settings *settings);
+void trace_thread(char *name, int device_id);
+double trace_now(void);
+void trace_span(const char *name, double start);
+cl_event *trace_enqueue_begin(const char *name);
+void trace_enqueue_end(cl_event *event);
+void trace_collect(void);
+void trace_write(ga_settings *settings);
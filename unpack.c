@@ -0,0 +1,125 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "main.h"
+#include "container.h"
+
+/*
+ * Decodes a waterfall written by clauto --compress back into the raw rows of
+ * floats that clauto writes without it. A single loop may be picked with -l,
+ * which only reads that loop's block. The rows are written to standard output,
+ * or to a file with -o.
+ */
+int main(int argc, char *argv[])
+{
+    int                 c;
+    char                *output_file = NULL;
+    long long           loop = -1;
+    container_header    header;
+    container_entry     *index;
+    FILE                *fp;
+    FILE                *out = stdout;
+
+    for (;;)
+    {
+        c = getopt(argc, argv, "l:o:");
+
+        // No more options, exit the loop
+        if (c == -1)
+        {
+            break;
+        }
+
+        if (c == 'l')
+        {
+            loop = atoll(optarg);
+        }
+        else if (c == 'o')
+        {
+            output_file = optarg;
+        }
+        else
+        {
+            fprintf(stderr, "Invalid command-line options supplied\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        fprintf(stderr, "Usage: %s [-l loop] [-o output] container\n",
+            argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    char *filename = argv[optind];
+    fp = container_open(filename, &header, &index);
+
+    if (output_file != NULL)
+    {
+        out = fopen(output_file, "wb");
+
+        if (out == NULL)
+        {
+            fprintf(stderr, "%s: ", output_file);
+            perror("");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Decode the one loop asked for, or every block in loop order
+    long long first = loop >= 0 ? loop : 0;
+    long long n = loop >= 0 ? 1 : header.n_blocks;
+    long long raw_bytes = 0;
+    long long size = 0;
+
+    for (long long i = 0; i < n; i++)
+    {
+        long long l = loop >= 0 ? first : index[i].loop;
+        float *rows = container_read(filename, fp, &header, index, l);
+
+        if (rows == NULL)
+        {
+            fprintf(stderr, "%s: No block for loop %lld\n", filename, l);
+            exit(EXIT_FAILURE);
+        }
+
+        size_t n_floats = (size_t)header.rows*header.row_length;
+        if (fwrite(rows, sizeof(float), n_floats, out) != n_floats)
+        {
+            fprintf(stderr, "Unable to write the decoded rows\n");
+            exit(EXIT_FAILURE);
+        }
+
+        raw_bytes += n_floats*sizeof(float);
+        free(rows);
+    }
+
+    for (long long i = 0; i < header.n_blocks; i++)
+    {
+        size += index[i].size;
+    }
+
+    fprintf(stderr, "Decoded %lld of %lld blocks (%d rows of %d floats "
+        "each), %.1lf MiB; the container is %.2lf times smaller than the "
+        "rows\n", n, header.n_blocks, header.rows, header.row_length,
+        raw_bytes/1048576.0, size > 0 ?
+        (double)header.n_blocks*header.rows*header.row_length*
+        sizeof(float)/size : 0);
+
+    if (out != stdout && fclose(out) != 0)
+    {
+        fprintf(stderr, "%s: ", output_file);
+        perror("");
+        exit(EXIT_FAILURE);
+    }
+
+    fclose(fp);
+    free(index);
+
+    return 0;
+}
@@ -0,0 +1,98 @@
+#define _FILE_OFFSET_BITS 64
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <CL/opencl.h>
+
+#include "main.h"
+#include "trace.h"
+#include "writer.h"
+#include "waterfall.h"
+
+// Shared by all workers, which write their rows with pwrite
+int waterfall_fd = -1;
+
+/*
+ * Opens the waterfall file. The file is a sequence of rows of output_length
+ * floats, one row per decimate FFT frames, in time order, as averaged on the
+ * device by the sum kernel. With --compress it is instead a container of the
+ * same rows, compressed one loop at a time by a pool of writer threads.
+ */
+void waterfall_open(ga_settings *settings)
+{
+    if (settings->compress_threads > 0)
+    {
+        writer_open(settings->waterfall_file, settings->output_length,
+            settings->waterfall_rows, settings->compress_threads);
+
+        fprintf(stderr, "Waterfall: %d rows per loop, %d floats per row, "
+            "compressed by %d threads\n", settings->waterfall_rows,
+            settings->output_length, settings->compress_threads);
+        return;
+    }
+
+    waterfall_fd = open(settings->waterfall_file, O_WRONLY | O_CREAT | O_TRUNC,
+        0644);
+
+    if (waterfall_fd == -1)
+    {
+        fprintf(stderr, "%s: ", settings->waterfall_file);
+        perror("");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "Waterfall: %d rows per loop, %d floats per row\n",
+        settings->waterfall_rows, settings->output_length);
+}
+
+void waterfall_close(void)
+{
+    writer_close();
+
+    if (waterfall_fd != -1)
+    {
+        close(waterfall_fd);
+    }
+}
+
+/*
+ * Writes the rows for the given loops to their place in the waterfall file.
+ * Loops may be written in any order, so workers never wait for each other.
+ */
+void waterfall_write(ga_settings *settings, float *rows, long long loop,
+    int loops)
+{
+    size_t  loop_bytes = (size_t)settings->waterfall_rows*
+        settings->output_length*sizeof(float);
+    size_t  n_bytes = loops*loop_bytes;
+    off_t   offset = (off_t)(loop*loop_bytes);
+    size_t  written = 0;
+    double  t_write = trace_now();
+
+    if (settings->compress_threads > 0)
+    {
+        writer_submit(rows, loop, loops);
+        trace_span("waterfall_write", t_write);
+        return;
+    }
+
+    while (written < n_bytes)
+    {
+        ssize_t ret = pwrite(waterfall_fd, (char *)rows + written,
+            n_bytes - written, offset + written);
+
+        if (ret == -1)
+        {
+            fprintf(stderr, "%s: ", settings->waterfall_file);
+            perror("");
+            exit(EXIT_FAILURE);
+        }
+
+        written += ret;
+    }
+
+    trace_span("waterfall_write", t_write);
+}
@@ -0,0 +1,4 @@
+void waterfall_open(ga_settings *settings);
+void waterfall_close(void);
+void waterfall_write(ga_settings *settings, float *rows, long long loop,
+    int loops);
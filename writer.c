@@ -0,0 +1,231 @@
+#define _FILE_OFFSET_BITS 64
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <CL/opencl.h>
+
+#include "main.h"
+#include "compress.h"
+#include "container.h"
+#include "trace.h"
+#include "writer.h"
+
+// Launches of rows which may wait for each writer thread before the workers
+// are held up
+#define WRITER_QUEUE_PER_THREAD 2
+
+typedef struct
+{
+    float       *rows;          // Copy of the rows, freed once written
+    long long   loop;           // First loop of the rows
+    int         loops;          // Number of loops of rows
+} writer_job;
+
+// Queue of launches waiting to be compressed
+writer_job      *writer_queue;
+int             writer_capacity;
+int             writer_head;
+int             writer_count;
+int             writer_done;
+pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  writer_not_empty = PTHREAD_COND_INITIALIZER;
+pthread_cond_t  writer_not_full = PTHREAD_COND_INITIALIZER;
+
+pthread_t       *writer_threads;
+int             writer_n_threads;
+
+// The container, and the index of the blocks written to it so far
+char            *writer_filename;
+FILE            *writer_fp = NULL;
+container_header writer_header;
+container_entry *writer_index;
+long long       writer_index_capacity;
+long long       writer_offset;
+
+// Totals for the report
+long long       writer_raw_bytes;
+long long       writer_compressed_bytes;
+double          writer_compress_us;
+
+/*
+ * Compresses each loop of the queued launches into a block of its own, and
+ * appends the blocks to the container in whatever order they are finished.
+ */
+void *writer_thread(void *arg)
+{
+    size_t  block_bytes = (size_t)writer_header.rows*
+        writer_header.row_length*sizeof(float);
+    void    *block = malloc(compress_bound(block_bytes));
+    char    name[32];
+
+    sprintf(name, "Writer %d", (int)(long)arg);
+    trace_thread(name, -1);
+
+    for (;;)
+    {
+        // Wait for a launch of rows, or for the end of the run
+        pthread_mutex_lock(&writer_lock);
+
+        while (writer_count == 0 && !writer_done)
+        {
+            pthread_cond_wait(&writer_not_empty, &writer_lock);
+        }
+
+        if (writer_count == 0)
+        {
+            pthread_mutex_unlock(&writer_lock);
+            break;
+        }
+
+        writer_job job = writer_queue[writer_head];
+        writer_head = (writer_head + 1) % writer_capacity;
+        writer_count--;
+        pthread_cond_signal(&writer_not_full);
+        pthread_mutex_unlock(&writer_lock);
+
+        for (int k = 0; k < job.loops; k++)
+        {
+            double t_compress = trace_now();
+            size_t size = compress_block((char *)job.rows + k*block_bytes,
+                block_bytes, block, sizeof(float));
+            double t_compressed = trace_now() - t_compress;
+            trace_span("compress", t_compress);
+
+            // Append the block and add it to the index
+            pthread_mutex_lock(&writer_lock);
+
+            if (writer_header.n_blocks == writer_index_capacity)
+            {
+                writer_index_capacity = 2*writer_index_capacity + 64;
+                writer_index = realloc(writer_index,
+                    writer_index_capacity*sizeof(container_entry));
+            }
+
+            container_entry *entry = &writer_index[writer_header.n_blocks++];
+            entry->loop = job.loop + k;
+            entry->offset = writer_offset;
+            entry->size = size;
+            entry->raw_size = block_bytes;
+
+            if (fwrite(block, 1, size, writer_fp) != size)
+            {
+                fprintf(stderr, "%s: ", writer_filename);
+                perror("");
+                exit(EXIT_FAILURE);
+            }
+
+            writer_offset += size;
+            writer_raw_bytes += block_bytes;
+            writer_compressed_bytes += size;
+            writer_compress_us += t_compressed;
+            pthread_mutex_unlock(&writer_lock);
+        }
+
+        free(job.rows);
+    }
+
+    free(block);
+
+    return NULL;
+}
+
+/*
+ * Creates a compressed container for rows of row_length floats, with rows
+ * rows per loop, and starts the threads which compress and write them.
+ */
+void writer_open(char *filename, int row_length, int rows, int n_threads)
+{
+    writer_filename = filename;
+    writer_header.row_length = row_length;
+    writer_header.rows = rows;
+    writer_header.n_blocks = 0;
+    writer_fp = container_create(filename, &writer_header);
+    writer_offset = ftello(writer_fp);
+
+    writer_capacity = WRITER_QUEUE_PER_THREAD*n_threads;
+    writer_queue = malloc(writer_capacity*sizeof(writer_job));
+    writer_head = 0;
+    writer_count = 0;
+    writer_done = 0;
+
+    writer_n_threads = n_threads;
+    writer_threads = malloc(n_threads*sizeof(pthread_t));
+
+    for (int i = 0; i < n_threads; i++)
+    {
+        pthread_create(&writer_threads[i], NULL, writer_thread,
+            (void *)(long)i);
+    }
+}
+
+/*
+ * Queues the rows of the given loops to be compressed. The rows are copied,
+ * so the caller may reuse them straight away. Blocks while the queue is full,
+ * so the workers never get more than a few launches ahead of the writers.
+ */
+void writer_submit(float *rows, long long loop, int loops)
+{
+    size_t      n_bytes = (size_t)loops*writer_header.rows*
+        writer_header.row_length*sizeof(float);
+    writer_job  job;
+
+    job.rows = malloc(n_bytes);
+    memcpy(job.rows, rows, n_bytes);
+    job.loop = loop;
+    job.loops = loops;
+
+    pthread_mutex_lock(&writer_lock);
+
+    while (writer_count == writer_capacity)
+    {
+        pthread_cond_wait(&writer_not_full, &writer_lock);
+    }
+
+    writer_queue[(writer_head + writer_count) % writer_capacity] = job;
+    writer_count++;
+    pthread_cond_signal(&writer_not_empty);
+    pthread_mutex_unlock(&writer_lock);
+}
+
+/*
+ * Waits for the queued rows to be written, finishes the container and
+ * reports the compression ratio and throughput.
+ */
+void writer_close(void)
+{
+    if (writer_fp == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&writer_lock);
+    writer_done = 1;
+    pthread_cond_broadcast(&writer_not_empty);
+    pthread_mutex_unlock(&writer_lock);
+
+    for (int i = 0; i < writer_n_threads; i++)
+    {
+        pthread_join(writer_threads[i], NULL);
+    }
+
+    container_finish(writer_filename, writer_fp, &writer_header,
+        writer_index);
+    writer_fp = NULL;
+
+    double ratio = writer_compressed_bytes > 0 ?
+        (double)writer_raw_bytes/writer_compressed_bytes : 0;
+    double rate = writer_compress_us > 0 ?
+        writer_raw_bytes/writer_compress_us : 0;
+
+    fprintf(stderr, "Compressed %lld blocks: %.1lf MiB to %.1lf MiB (ratio "
+        "%.2lf), %.1lf MB/s per thread with %d threads\n",
+        writer_header.n_blocks, writer_raw_bytes/1048576.0,
+        writer_compressed_bytes/1048576.0, ratio, rate, writer_n_threads);
+
+    free(writer_index);
+    free(writer_queue);
+    free(writer_threads);
+}
@@ -0,0 +1,3 @@
+void writer_open(char *filename, int row_length, int rows, int n_threads);
+void writer_submit(float *rows, long long loop, int loops);
+void writer_close(void);
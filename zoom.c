@@ -0,0 +1,158 @@
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <CL/opencl.h>
+
+#include "main.h"
+#include "cl_abstractions.h"
+#include "cl_error.h"
+#include "trace.h"
+#include "convert.h"
+#include "zoom.h"
+
+WORKER_LOCAL cl_kernel *zoom_kernel;
+
+// Work sizes and bound buffers, computed once and reused every loop
+WORKER_LOCAL size_t  zoom_global_size[1];
+WORKER_LOCAL size_t  zoom_local_size[1];
+WORKER_LOCAL cl_mem  zoom_input;
+WORKER_LOCAL cl_mem  zoom_data;
+WORKER_LOCAL cl_mem  zoom_taps;
+WORKER_LOCAL cl_mem  zoom_nco;
+
+/*
+ * Builds the zoom kernel and sets the arguments which do not change between
+ * loops, including the low-pass filter and the NCO frequency of each channel.
+ * The filter is a Blackman-windowed sinc which passes the decimated band,
+ * scaled for unit gain at DC.
+ */
+void zoom_initialise(ga_settings *settings, cl_vars *cl)
+{
+    cl_int      err_ret;
+    cl_program  *program;
+    float       lut[4];
+    int         n_taps = settings->zoom_taps;
+    int         history = settings->history*8/
+        (settings->channels*settings->bps);
+
+    // Create the program
+    program = malloc(sizeof(cl_program));
+    cl_create_program(cl, program, "zoom.cl");
+
+    // Create the kernel
+    zoom_kernel = malloc(sizeof(cl_kernel));
+    cl_create_kernel(cl, program, zoom_kernel, "zoom_2bit");
+
+    // Set work size, one work item per output sample of each channel
+    int zoom_length = settings->channels*settings->spc/settings->zoom;
+    int nt = MIN(zoom_length, cl->max_work_size);
+    zoom_global_size[0] = zoom_length;
+    zoom_local_size[0] = nt;
+
+    // Design the low-pass filter
+    float   *taps = malloc(n_taps*sizeof(float));
+    double  cutoff = 0.5/settings->zoom;
+    double  gain = 0;
+
+    for (int j = 0; j < n_taps; j++)
+    {
+        double x = j - (n_taps - 1)/2.0;
+        double w = 0.42 - 0.5*cos(2*M_PI*j/(n_taps - 1)) +
+            0.08*cos(4*M_PI*j/(n_taps - 1));
+        double h = (x == 0) ? 2*cutoff : sin(2*M_PI*cutoff*x)/(M_PI*x);
+
+        taps[j] = w*h;
+        gain += taps[j];
+    }
+
+    for (int j = 0; j < n_taps; j++)
+    {
+        taps[j] /= gain;
+    }
+
+    // NCO frequency of each channel, in 2^-32 turns per sample
+    cl_uint *nco = malloc(settings->channels*sizeof(cl_uint));
+
+    for (int c = 0; c < settings->channels; c++)
+    {
+        nco[c] = (cl_uint)(settings->zoom_centre[c]*4294967296.0 + 0.5);
+    }
+
+    zoom_taps = clCreateBuffer(cl->context,
+        CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, n_taps*sizeof(float), taps,
+        &err_ret);
+    check_error(__FILE__, __LINE__, err_ret);
+    zoom_nco = clCreateBuffer(cl->context,
+        CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+        settings->channels*sizeof(cl_uint), nco, &err_ret);
+    check_error(__FILE__, __LINE__, err_ret);
+    free(taps);
+    free(nco);
+
+    convert_lut(settings, lut);
+
+    // Set the kernel arguments which are constant for the whole run
+    err_ret = clSetKernelArg(*zoom_kernel, 2, sizeof(zoom_taps),
+        (void *)&zoom_taps);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*zoom_kernel, 3, sizeof(zoom_nco),
+        (void *)&zoom_nco);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*zoom_kernel, 4, sizeof(lut), (void *)&lut);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*zoom_kernel, 5, sizeof(settings->spc),
+        (void *)&settings->spc);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*zoom_kernel, 6, sizeof(settings->channels),
+        (void *)&settings->channels);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*zoom_kernel, 7, sizeof(settings->zoom),
+        (void *)&settings->zoom);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*zoom_kernel, 8, sizeof(n_taps),
+        (void *)&n_taps);
+    check_error(__FILE__, __LINE__, err_ret);
+    err_ret = clSetKernelArg(*zoom_kernel, 9, sizeof(history),
+        (void *)&history);
+    check_error(__FILE__, __LINE__, err_ret);
+}
+
+/*
+ * Executes the zoom kernel over the given number of consecutive loops of
+ * input, which follow the history at the start of the input buffer. Only the
+ * buffer arguments are set here, and only when they differ from those bound
+ * by the previous call.
+ */
+void zoom_module(ga_settings *settings, cl_vars *cl, cl_mem dev_input,
+    cl_mem dev_data, int loops)
+{
+    cl_int      err_ret;
+    size_t      global_work_size[1];
+
+    // Rebind the buffers if they have changed
+    if (dev_input != zoom_input)
+    {
+        err_ret = clSetKernelArg(*zoom_kernel, 0, sizeof(dev_input),
+            (void *)&dev_input);
+        check_error(__FILE__, __LINE__, err_ret);
+        zoom_input = dev_input;
+    }
+
+    if (dev_data != zoom_data)
+    {
+        err_ret = clSetKernelArg(*zoom_kernel, 1, sizeof(dev_data),
+            (void *)&dev_data);
+        check_error(__FILE__, __LINE__, err_ret);
+        zoom_data = dev_data;
+    }
+
+    // Execute kernel
+    global_work_size[0] = loops*zoom_global_size[0];
+    cl_event *event = trace_enqueue_begin("zoom");
+    err_ret = clEnqueueNDRangeKernel(cl->queue, *zoom_kernel, 1, NULL,
+        global_work_size, zoom_local_size, 0, NULL, event);
+    trace_enqueue_end(event);
+    check_error(__FILE__, __LINE__, err_ret);
+}
@@ -0,0 +1,52 @@
+/*
+ * Zoom mode: decodes the 2-bit input, mixes each channel down with a complex
+ * NCO, low-pass filters it and decimates it, in a single pass, so only the
+ * narrowband stream is ever written to the data buffer. One work item
+ * computes one output sample m of one channel of one loop:
+ *
+ *     y[m] = sum_j taps[j] x[mD - j] exp(-2 pi i f (mD - j))
+ *
+ * The input buffer starts with history samples from before the first loop,
+ * so the filter runs on continuously from one loop to the next. The NCO phase
+ * is kept in fixed point as a fraction of a turn, so it is exact for any
+ * loop length, and restarts with each loop.
+ */
+__kernel void zoom_2bit(__global const unsigned char *input,
+    __global float2 *data, __global const float *taps,
+    __constant unsigned int *nco, __const float4 lut, __const int spc,
+    __const int channels, __const int decimate, __const int n_taps,
+    __const int history)
+{
+    int idx = get_global_id(0);
+    int zoom_spc = spc/decimate;
+    int m = idx%zoom_spc;
+    int c = (idx/zoom_spc)%channels;
+    int k = idx/(zoom_spc*channels);
+
+    // Interpet the LUT as an array
+    float *lp = (float *)&lut;
+
+    // Each time sample takes a byte for every four channels
+    int width = channels/4;
+    int byte = c/4;
+    int shift = 2*(c%4);
+
+    // Newest sample in the filter, relative to the start of its loop
+    int t0 = m*decimate;
+    __global const unsigned char *loop_input = input +
+        (history + k*spc)*width;
+    unsigned int inc = nco[c];
+
+    float2 acc = (float2)(0, 0);
+    for (int j = 0; j < n_taps; j++)
+    {
+        int t = t0 - j;
+        float x = taps[j]*lp[(loop_input[t*width + byte] >> shift) & 0x03];
+        float turns = (inc*(unsigned int)t)*(1.0f/4294967296.0f);
+
+        acc.x += x*cospi(2*turns);
+        acc.y -= x*sinpi(2*turns);
+    }
+
+    data[(k*channels + c)*zoom_spc + m] = acc;
+}
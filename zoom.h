@@ -0,0 +1,3 @@
+void zoom_initialise(ga_settings *settings, cl_vars *cl);
+void zoom_module(ga_settings *settings, cl_vars *cl, cl_mem dev_input,
+    cl_mem dev_data, int loops);